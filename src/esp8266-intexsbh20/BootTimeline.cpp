@@ -0,0 +1,76 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     BootTimeline.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "BootTimeline.h"
+
+#include "MQTTClient.h"
+#include "common.h"
+
+
+/**
+ * record time of boot phase, only first call per phase is recorded
+ *
+ * @param phase
+ */
+void BootTimeline::mark(PHASE phase)
+{
+  if (!phaseTime[phase])
+  {
+    // 0 is reserved for "not reached"
+    unsigned long now = millis();
+    phaseTime[phase] = now? now : 1;
+  }
+}
+
+bool BootTimeline::isMarked(PHASE phase) const
+{
+  return phaseTime[phase] != 0;
+}
+
+void BootTimeline::setFastConnect(bool fast)
+{
+  fastConnect = fast;
+}
+
+/**
+ * publish boot phase times [ms] once after first publish of pool state
+ * when the pool state is complete or a timeout has expired
+ *
+ * note: phases not reached are reported as 0
+ */
+void BootTimeline::publish(MQTTClient& mqttClient)
+{
+  if (!published && isMarked(PHASE::FIRST_PUBLISH)
+      && (isMarked(PHASE::STATE_COMPLETE) || timeDiff(millis(), phaseTime[PHASE::FIRST_PUBLISH]) > COMPLETE_TIMEOUT))
+  {
+    char buf[BUFFER_SIZE];
+    snprintf_P(buf, BUFFER_SIZE, PSTR("{\"config\":%lu,\"wifi\":%lu,\"fast\":%u,\"mqtt\":%lu,\"frame\":%lu,\"publish\":%lu,\"complete\":%lu}"),
+               phaseTime[PHASE::CONFIG_LOADED], phaseTime[PHASE::WIFI_CONNECTED], fastConnect,
+               phaseTime[PHASE::MQTT_CONNECTED], phaseTime[PHASE::FIRST_FRAME], phaseTime[PHASE::FIRST_PUBLISH],
+               phaseTime[PHASE::STATE_COMPLETE]);
+    published = mqttClient.publish(MQTT_TOPIC::BOOT, buf, false, true);
+  }
+}
@@ -0,0 +1,69 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     BootTimeline.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <c_types.h>
+
+class MQTTClient;
+
+
+/**
+ * records the time of the boot phases since reset and publishes them once per boot
+ */
+class BootTimeline
+{
+public:
+  enum PHASE
+  {
+    CONFIG_LOADED = 0,
+    WIFI_CONNECTED,
+    MQTT_CONNECTED,
+    FIRST_FRAME,
+    FIRST_PUBLISH,
+    STATE_COMPLETE,
+    COUNT
+  };
+
+public:
+  void mark(PHASE phase);
+  bool isMarked(PHASE phase) const;
+  void setFastConnect(bool fast);
+
+  void publish(MQTTClient& mqttClient);
+
+private:
+  static const unsigned int BUFFER_SIZE = 144;
+  static const unsigned long COMPLETE_TIMEOUT = 60000; // [ms] max. wait for complete pool state after first publish
+
+private:
+  unsigned long phaseTime[PHASE::COUNT] = {};
+  bool fastConnect = false;
+  bool published = false;
+};
+
+#endif /* BOOT_TIMELINE_H */
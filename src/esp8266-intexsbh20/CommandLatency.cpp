@@ -0,0 +1,190 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     CommandLatency.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#include "CommandLatency.h"
+
+#include "MQTTClient.h"
+#include "PureSpaIO.h"
+#include "common.h"
+
+
+namespace LATENCY_METRIC
+{
+  const char DISPATCH[]     PROGMEM = "cmd_dispatch_ms";
+  const char REPLY[]        PROGMEM = "cmd_reply_ms";
+  const char ACK[]          PROGMEM = "cmd_ack_ms";
+  const char CONFIRM[]      PROGMEM = "cmd_confirm_ms";
+  const char PUBLISH[]      PROGMEM = "cmd_publish_ms";
+
+  const char BUBBLE[]       PROGMEM = "cmd_bubble_ms";
+  const char DISINFECTION[] PROGMEM = "cmd_disinfection_ms";
+  const char FILTER[]       PROGMEM = "cmd_filter_ms";
+  const char HEATER[]       PROGMEM = "cmd_heater_ms";
+  const char JET[]          PROGMEM = "cmd_jet_ms";
+  const char POWER[]        PROGMEM = "cmd_power_ms";
+  const char SCENE[]        PROGMEM = "cmd_scene_ms";
+  const char WATER_TEMP[]   PROGMEM = "cmd_water_temp_ms";
+
+  const uint32 BOUNDS[] = { 10, 50, 100, 250, 500, 1000, 2500 }; // [ms]
+
+  const char* const COMMAND_NAMES[CommandLatency::COMMAND::COMMANDS] = { "bubble", "disinfection", "filter", "heater", "jet", "power", "scene", "tempSet" };
+}
+
+Metrics::FixedHistogram<7> CommandLatency::phaseDuration[PHASE::PHASES] = {
+  { LATENCY_METRIC::DISPATCH, LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::REPLY,    LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::ACK,      LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::CONFIRM,  LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::PUBLISH,  LATENCY_METRIC::BOUNDS }
+};
+
+Metrics::FixedHistogram<7> CommandLatency::commandDuration[COMMAND::COMMANDS] = {
+  { LATENCY_METRIC::BUBBLE,       LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::DISINFECTION, LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::FILTER,       LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::HEATER,       LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::JET,          LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::POWER,        LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::SCENE,        LATENCY_METRIC::BOUNDS },
+  { LATENCY_METRIC::WATER_TEMP,   LATENCY_METRIC::BOUNDS }
+};
+
+
+/**
+ * start measurement before calling the setter of the command,
+ * a measurement in progress is ended
+ *
+ * @param command
+ * @param arrivalTime [µs] arrival of MQTT message
+ * @param pureSpaIO
+ */
+void CommandLatency::begin(COMMAND command, uint32 arrivalTime, PureSpaIO& pureSpaIO)
+{
+  this->command = command;
+  this->arrivalTime = arrivalTime;
+  pureSpaIO.startCommandTiming(micros());
+  pureSpaIO.startCommandResult();
+}
+
+/**
+ * publish result of command as JSON after setter returned
+ *
+ * format: {"command":"<name>","outcome":"<outcome>","presses":<n>,"retries":<n>,"repeats":<n>,"duration":<ms>}
+ *
+ * @param pureSpaIO
+ * @param mqttClient
+ */
+void CommandLatency::publishResult(PureSpaIO& pureSpaIO, MQTTClient& mqttClient) const
+{
+  if (command == COMMAND::COMMANDS)
+  {
+    return;
+  }
+
+  PureSpaIO::CommandResult result;
+  pureSpaIO.getCommandResult(result);
+
+  char buf[BUFFER_SIZE];
+  int length = snprintf_P(buf, BUFFER_SIZE, PSTR("{\"command\":\"%s\",\"outcome\":\"%s\",\"presses\":%u,\"retries\":%u,\"repeats\":%u,\"duration\":%lu}"),
+                          LATENCY_METRIC::COMMAND_NAMES[command], PureSpaIO::getOutcomeName(result.outcome),
+                          result.presses, result.retries, result.repeats, result.duration);
+  if (length < (int)BUFFER_SIZE)
+  {
+    mqttClient.publish(MQTT_TOPIC::RESULT, buf, false, true);
+  }
+}
+
+/**
+ * end measurement with the first publish of the pool state after the command
+ * was confirmed or after a timeout
+ *
+ * @param publishTime [µs] time of last publish of pool state
+ * @param pureSpaIO
+ * @param mqttClient
+ */
+void CommandLatency::loop(uint32 publishTime, PureSpaIO& pureSpaIO, MQTTClient& mqttClient)
+{
+  if (command == COMMAND::COMMANDS)
+  {
+    return;
+  }
+
+  PureSpaIO::CommandTiming timing;
+  pureSpaIO.getCommandTiming(timing);
+  bool published = timing.confirm && (sint32)(publishTime - timing.confirm) >= 0;
+  if (published || (micros() - arrivalTime) > TIMEOUT)
+  {
+    pureSpaIO.stopCommandTiming();
+    const uint32 stageTime[PHASES + 1] = { arrivalTime, timing.start, timing.reply, timing.ack, timing.confirm, published? publishTime : 0 };
+    end(stageTime, mqttClient);
+    command = COMMAND::COMMANDS;
+  }
+}
+
+/**
+ * aggregate durations of reached phases and publish phases as JSON
+ *
+ * format: {"command":"<name>","<phase>":<ms>,...}, -1 = phase not reached
+ *
+ * @param stageTime [µs] start time of each phase and end time of last phase, 0 = not reached
+ * @param mqttClient
+ */
+void CommandLatency::end(const uint32 (&stageTime)[PHASES + 1], MQTTClient& mqttClient)
+{
+  static const char* const PHASE_NAMES[PHASE::PHASES] = { "dispatch", "reply", "ack", "confirm", "publish" };
+
+  char buf[BUFFER_SIZE];
+  int length = snprintf_P(buf, BUFFER_SIZE, PSTR("{\"command\":\"%s\""), LATENCY_METRIC::COMMAND_NAMES[command]);
+  uint32 phaseStart = stageTime[0];
+  for (unsigned int i=0; i<PHASE::PHASES; i++)
+  {
+    int duration = -1;
+    if (stageTime[i + 1])
+    {
+      // phases may overlap when stages are reported by the same frame
+      sint32 d = stageTime[i + 1] - phaseStart;
+      duration = d > 0? d/1000 : 0;
+      phaseDuration[i].observe(duration);
+      phaseStart = stageTime[i + 1];
+    }
+    if (length < (int)BUFFER_SIZE)
+    {
+      length += snprintf_P(buf + length, BUFFER_SIZE - length, PSTR(",\"%s\":%d"), PHASE_NAMES[i], duration);
+    }
+  }
+
+  if (stageTime[PHASES])
+  {
+    commandDuration[command].observe((stageTime[PHASES] - stageTime[0])/1000);
+  }
+
+  if (length < (int)BUFFER_SIZE - 1)
+  {
+    strcat(buf, "}");
+    mqttClient.publish(MQTT_TOPIC::LATENCY, buf, false, true);
+  }
+}
@@ -0,0 +1,101 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     CommandLatency.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#ifndef COMMAND_LATENCY_H
+#define COMMAND_LATENCY_H
+
+#include <c_types.h>
+#include "Metrics.h"
+
+class MQTTClient;
+class PureSpaIO;
+
+
+/**
+ * Measures the latency of MQTT commands in phases:
+ *
+ * DISPATCH: arrival of MQTT message until setter is called
+ * REPLY:    until first button frame is answered
+ * ACK:      until buzzer is on
+ * CONFIRM:  until LED status or desired water temperature changed
+ * PUBLISH:  until new pool state is published
+ *
+ * The phases are aggregated in histograms per phase and the total latency in
+ * histograms per command. The phases of each command are published as JSON.
+ *
+ * The outcome, button presses, retries and auto repeats of each command are
+ * published as JSON when the setter returns.
+ */
+class CommandLatency
+{
+public:
+  enum COMMAND
+  {
+    BUBBLE = 0,
+    DISINFECTION,
+    FILTER,
+    HEATER,
+    JET,
+    POWER,
+    SCENE,
+    WATER_TEMP,
+    COMMANDS
+  };
+
+  enum PHASE
+  {
+    DISPATCH = 0,
+    REPLY,
+    ACK,
+    CONFIRM,
+    PUBLISH,
+    PHASES
+  };
+
+public:
+  void begin(COMMAND command, uint32 arrivalTime, PureSpaIO& pureSpaIO);
+  void loop(uint32 publishTime, PureSpaIO& pureSpaIO, MQTTClient& mqttClient);
+  void publishResult(PureSpaIO& pureSpaIO, MQTTClient& mqttClient) const;
+
+private:
+  static const uint32 TIMEOUT = 10000000; // [µs] max. duration of command until publish
+  static const unsigned int BUFFER_SIZE = 128;
+
+private:
+  void end(const uint32 (&stageTime)[PHASES + 1], MQTTClient& mqttClient);
+
+private:
+  COMMAND command = COMMAND::COMMANDS;
+  uint32 arrivalTime = 0;
+
+private:
+  // metrics
+  static Metrics::FixedHistogram<7> phaseDuration[PHASE::PHASES];
+  static Metrics::FixedHistogram<7> commandDuration[COMMAND::COMMANDS];
+};
+
+#endif /* COMMAND_LATENCY_H */
@@ -0,0 +1,262 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     HeapTracker.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#include "HeapTracker.h"
+
+#include <new>
+#include <Esp.h>
+
+
+namespace HEAP_METRIC
+{
+  const char ALLOCS_OTHER[]          PROGMEM = "heap_allocs_other_total";
+  const char ALLOCS_MQTT_CLIENT[]    PROGMEM = "heap_allocs_mqtt_client_total";
+  const char ALLOCS_MQTT_PUBLISHER[] PROGMEM = "heap_allocs_mqtt_publisher_total";
+  const char ALLOCS_PURE_SPA_IO[]    PROGMEM = "heap_allocs_pool_total";
+  const char ALLOCS_OTA_UPDATE[]     PROGMEM = "heap_allocs_ota_total";
+  const char RELEASES[]              PROGMEM = "heap_releases_total";
+  const char VIOLATIONS[]            PROGMEM = "heap_alloc_violations_total";
+  const char LOOP_ALLOCS_MAX[]       PROGMEM = "heap_loop_allocs_max";
+  const char FREE[]                  PROGMEM = "heap_free_bytes";
+  const char LOW_WATER[]             PROGMEM = "heap_low_water_bytes";
+  const char MAX_BLOCK[]             PROGMEM = "heap_max_block_bytes";
+  const char FRAGMENTATION[]         PROGMEM = "heap_fragmentation_percent";
+
+  const char* const TAG_NAMES[HeapTracker::TAG::COUNT] = { "other", "MQTT client", "MQTT publisher", "pool", "OTA" };
+}
+
+HeapTracker::TAG HeapTracker::tag = HeapTracker::TAG::OTHER;
+uint32 HeapTracker::allocationCount[TAG::COUNT] = {};
+uint32 HeapTracker::releaseCount = 0;
+uint32 HeapTracker::violationCount = 0;
+bool HeapTracker::assertNoAlloc = false;
+uint32 HeapTracker::loopAllocations = 0;
+uint32 HeapTracker::loopAllocationsPeak = 0;
+uint32 HeapTracker::lowWater = UINT_MAX;
+uint32 HeapTracker::violationSize = 0;
+HeapTracker::TAG HeapTracker::violationTag = HeapTracker::TAG::OTHER;
+
+Metrics::Counter HeapTracker::allocations[TAG::COUNT] = {
+                                                          HEAP_METRIC::ALLOCS_OTHER,
+                                                          HEAP_METRIC::ALLOCS_MQTT_CLIENT,
+                                                          HEAP_METRIC::ALLOCS_MQTT_PUBLISHER,
+                                                          HEAP_METRIC::ALLOCS_PURE_SPA_IO,
+                                                          HEAP_METRIC::ALLOCS_OTA_UPDATE
+                                                        };
+Metrics::Counter HeapTracker::releases(HEAP_METRIC::RELEASES);
+Metrics::Counter HeapTracker::violations(HEAP_METRIC::VIOLATIONS);
+Metrics::Gauge HeapTracker::loopAllocationsMax(HEAP_METRIC::LOOP_ALLOCS_MAX);
+Metrics::Gauge HeapTracker::heapFree(HEAP_METRIC::FREE);
+Metrics::Gauge HeapTracker::heapLowWater(HEAP_METRIC::LOW_WATER);
+Metrics::Gauge HeapTracker::heapMaxBlock(HEAP_METRIC::MAX_BLOCK);
+Metrics::Gauge HeapTracker::heapFragmentation(HEAP_METRIC::FRAGMENTATION);
+
+
+#ifdef HEAP_TRACKER_WRAP_MALLOC
+/**
+ * wrapper of the C heap functions, requires the linker options
+ * -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+ * (see platformio.ini), placed in IRAM because the SDK may allocate in
+ * ISR context
+ */
+extern "C"
+{
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t count, size_t size);
+  void* __real_realloc(void* p, size_t size);
+  void __real_free(void* p);
+
+  IRAM_ATTR void* __wrap_malloc(size_t size)
+  {
+    HeapTracker::allocated(size);
+    return __real_malloc(size);
+  }
+
+  IRAM_ATTR void* __wrap_calloc(size_t count, size_t size)
+  {
+    HeapTracker::allocated(count*size);
+    return __real_calloc(count, size);
+  }
+
+  IRAM_ATTR void* __wrap_realloc(void* p, size_t size)
+  {
+    HeapTracker::allocated(size);
+    return __real_realloc(p, size);
+  }
+
+  IRAM_ATTR void __wrap_free(void* p)
+  {
+    if (p)
+    {
+      HeapTracker::released();
+    }
+    __real_free(p);
+  }
+}
+#endif
+
+/**
+ * replacement of the C++ allocation operators of libstdc++, counted by the
+ * malloc() wrapper if enabled
+ */
+void* operator new(size_t size)
+{
+#ifndef HEAP_TRACKER_WRAP_MALLOC
+  HeapTracker::allocated(size);
+#endif
+  void* p = malloc(size);
+  if (!p && size)
+  {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  if (p)
+  {
+#ifndef HEAP_TRACKER_WRAP_MALLOC
+    HeapTracker::released();
+#endif
+    free(p);
+  }
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+
+HeapTracker::Scope::Scope(TAG tag) :
+  previous(HeapTracker::tag)
+{
+  HeapTracker::tag = tag;
+}
+
+HeapTracker::Scope::~Scope()
+{
+  HeapTracker::tag = previous;
+}
+
+/**
+ * count allocation, safe in ISR context
+ */
+IRAM_ATTR void HeapTracker::allocated(size_t size)
+{
+  uint32 savedPS = xt_rsil(15);
+  allocationCount[tag]++;
+  loopAllocations++;
+  if (assertNoAlloc && tag != TAG::OTHER)
+  {
+    violationCount++;
+    violationTag = tag;
+    violationSize = size;
+  }
+  xt_wsr_ps(savedPS);
+}
+
+/**
+ * count release, safe in ISR context
+ */
+IRAM_ATTR void HeapTracker::released()
+{
+  uint32 savedPS = xt_rsil(15);
+  releaseCount++;
+  xt_wsr_ps(savedPS);
+}
+
+/**
+ * call once at the end of each loop pass to update the allocations per loop
+ * pass and the low-water mark, reports assertion violations on serial port
+ */
+void HeapTracker::loop()
+{
+  uint32 savedPS = xt_rsil(15);
+  uint32 allocs = loopAllocations;
+  loopAllocations = 0;
+  xt_wsr_ps(savedPS);
+  if (allocs > loopAllocationsPeak)
+  {
+    loopAllocationsPeak = allocs;
+  }
+
+  uint32 freeHeap = ESP.getFreeHeap();
+  if (freeHeap < lowWater)
+  {
+    lowWater = freeHeap;
+  }
+
+  if (violationSize)
+  {
+    Serial.printf_P(PSTR("heap allocation of %u bytes in %s\n"), violationSize, HEAP_METRIC::TAG_NAMES[violationTag]);
+    violationSize = 0;
+  }
+}
+
+/**
+ * update heap metrics and max. allocations per loop pass since last call
+ *
+ * note: call before publishing the metrics, allocations while publishing
+ *       are reported by the next call
+ */
+void HeapTracker::sample()
+{
+  uint32 savedPS = xt_rsil(15);
+  for (unsigned int i=0; i<TAG::COUNT; i++)
+  {
+    allocations[i].set(allocationCount[i]);
+  }
+  releases.set(releaseCount);
+  violations.set(violationCount);
+  xt_wsr_ps(savedPS);
+
+  uint32 freeHeap;
+  uint32 maxBlock;
+  uint8 fragmentation;
+  ESP.getHeapStats(&freeHeap, &maxBlock, &fragmentation);
+
+  heapFree.set(freeHeap);
+  heapLowWater.set(lowWater < freeHeap? lowWater : freeHeap);
+  heapMaxBlock.set(maxBlock);
+  heapFragmentation.set(fragmentation);
+
+  loopAllocationsMax.set(loopAllocationsPeak);
+  loopAllocationsPeak = 0;
+}
+
+/**
+ * enable or disable no-alloc assertion mode
+ *
+ * @param enable
+ */
+void HeapTracker::setAssertNoAlloc(bool enable)
+{
+  assertNoAlloc = enable;
+}
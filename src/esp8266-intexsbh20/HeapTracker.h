@@ -0,0 +1,117 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     HeapTracker.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#ifndef HEAP_TRACKER_H
+#define HEAP_TRACKER_H
+
+#include <c_types.h>
+#include <Arduino.h>
+#include "Metrics.h"
+
+
+/**
+ * Counts heap allocations per subsystem tag and per loop pass and monitors
+ * free heap, largest free block, fragmentation and the low-water mark of the
+ * free heap since boot.
+ *
+ * The subsystem is selected by a Scope object, allocations outside of any
+ * scope are counted as OTHER.
+ *
+ * In no-alloc assertion mode every allocation within a scope is reported as
+ * violation. Enable it after the startup phase to prove that the tagged
+ * paths no longer allocate in steady state.
+ *
+ * note: with HEAP_TRACKER_WRAP_MALLOC and the matching linker options (see
+ *       platformio.ini) malloc(), calloc(), realloc() and free() are hooked,
+ *       e.g. used by String, PubSubClient and ArduinoJson, otherwise only the
+ *       C++ operator new is hooked and the C allocations are only reflected
+ *       in the free heap and fragmentation
+ *
+ * note: the allocation hooks may be called from ISR context, e.g. by the SDK,
+ *       they are placed in IRAM and only update plain counters with
+ *       interrupts disabled, the metrics are updated from these counters by
+ *       sample() in main context, so they do not change while being published
+ */
+class HeapTracker
+{
+public:
+  enum TAG
+  {
+    OTHER = 0,
+    MQTT_CLIENT,
+    MQTT_PUBLISHER,
+    PURE_SPA_IO,
+    OTA_UPDATE,
+    COUNT
+  };
+
+  class Scope
+  {
+  public:
+    Scope(TAG tag);
+    ~Scope();
+
+  private:
+    TAG previous;
+  };
+
+public:
+  static void loop();
+  static void sample();
+
+  static void setAssertNoAlloc(bool enable);
+
+public:
+  // allocation hooks
+  static IRAM_ATTR void allocated(size_t size);
+  static IRAM_ATTR void released();
+
+private:
+  static TAG tag;
+  static uint32 allocationCount[TAG::COUNT];
+  static uint32 releaseCount;
+  static uint32 violationCount;
+  static bool assertNoAlloc;
+  static uint32 loopAllocations;
+  static uint32 loopAllocationsPeak;
+  static uint32 lowWater;
+  static uint32 violationSize;
+  static TAG violationTag;
+
+private:
+  // metrics
+  static Metrics::Counter allocations[TAG::COUNT];
+  static Metrics::Counter releases;
+  static Metrics::Counter violations;
+  static Metrics::Gauge loopAllocationsMax;
+  static Metrics::Gauge heapFree;
+  static Metrics::Gauge heapLowWater;
+  static Metrics::Gauge heapMaxBlock;
+  static Metrics::Gauge heapFragmentation;
+};
+
+#endif /* HEAP_TRACKER_H */
@@ -29,13 +29,54 @@
 #include "common.h"
 
 
+namespace MQTT_METRIC
+{
+  const char CONNECTS[]         PROGMEM = "mqtt_connects_total";
+  const char CONNECT_FAILURES[] PROGMEM = "mqtt_connect_failures_total";
+  const char PUBLISHED[]        PROGMEM = "mqtt_published_total";
+  const char RECEIVED[]         PROGMEM = "mqtt_received_total";
+}
+
+Metrics::Counter MQTTClient::connects(MQTT_METRIC::CONNECTS);
+Metrics::Counter MQTTClient::connectFailures(MQTT_METRIC::CONNECT_FAILURES);
+Metrics::Counter MQTTClient::published(MQTT_METRIC::PUBLISHED);
+Metrics::Counter MQTTClient::received(MQTT_METRIC::RECEIVED);
+
+/**
+ * Print that only counts the bytes written
+ */
+class PrintLength : public Print
+{
+public:
+  size_t write(uint8_t) override { length++; return 1; }
+  size_t write(const uint8_t*, size_t size) override { length += size; return size; }
+  size_t get() const { return length; }
+
+private:
+  size_t length = 0;
+};
+
 /**
  * MQTT subscription received callback
  */
 void MQTTClient::subscriptionUpdate(char* topic, byte* message, unsigned int length)
 {
+  receiveTime = micros();
+  received.inc();
+
+  // pass binary payload unmodified, note: topic and payload will be invalid after publishing
+  auto r = rawSubscriber.find(topic);
+  if (r != rawSubscriber.end())
+  {
+    r->second(message, length);
+    return;
+  }
+
   message[length] = '\0';
 
+  // copy topic, publishing by subscriber will overwrite it
+  String t = topic;
+
   // find subscription for topic
   auto i = boolSubscriber.find(topic);
   if (i != boolSubscriber.end())
@@ -58,7 +99,6 @@ void MQTTClient::subscriptionUpdate(char* topic, byte* message, unsigned int len
   }
 
   // remove last transmitted state topic and the will topic to force retransmission
-  String t = topic;
   String c = "command/";
   int p = t.indexOf(c);
   if (p >= 0)
@@ -81,6 +121,21 @@ void MQTTClient::setup(const char* mqttServer, uint16 mqttPort, const char* mqtt
   mqttClient.setCallback(std::bind(&MQTTClient::subscriptionUpdate, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 }
 
+/**
+ * change client ID, reconnects if already connected
+ */
+void MQTTClient::setClientId(const char* cid)
+{
+  if (!clientId || strcmp(cid, clientId) != 0)
+  {
+    clientId = cid;
+    if (mqttClient.connected())
+    {
+      mqttClient.disconnect();
+    }
+  }
+}
+
 void MQTTClient::reconnect()
 {
   if (!mqttClient.connected() && timeDiff(now, lastConnectTime) > RECONNECT_DELAY)
@@ -91,6 +146,7 @@ void MQTTClient::reconnect()
     {
       // connected
       Serial.println("success");
+      connects.inc();
 
       // publish metadata
       if (!lastConnectTime)
@@ -110,8 +166,13 @@ void MQTTClient::reconnect()
       {
         mqttClient.subscribe(s.first.c_str());
       }
+      for (auto s: rawSubscriber)
+      {
+        mqttClient.subscribe(s.first.c_str());
+      }
     } else {
       Serial.printf("failed, rc=%d\n", mqttClient.state());
+      connectFailures.inc();
     }
     lastConnectTime = now;
   }
@@ -130,19 +191,56 @@ void MQTTClient::loop()
   mqttClient.loop();
 }
 
+/**
+ * add or replace retained metadata, published immediately if already connected
+ */
 void MQTTClient::addMetadata(const char* topic, const char* message)
 {
   metadata[topic] = message;
+  if (mqttClient.connected())
+  {
+    mqttClient.publish(topic, message, true);
+  }
 }
 
+/**
+ * add subscriber, subscribed immediately if already connected
+ */
 void MQTTClient::addSubscriber(const char* topic, void (*setter)(bool value))
 {
   boolSubscriber[topic] = setter;
+  if (mqttClient.connected())
+  {
+    mqttClient.subscribe(topic);
+  }
 }
 
 void MQTTClient::addSubscriber(const char* topic, void (*setter)(int value))
 {
   intSubscriber[topic] = setter;
+  if (mqttClient.connected())
+  {
+    mqttClient.subscribe(topic);
+  }
+}
+
+void MQTTClient::addSubscriber(const char* topic, void (*receiver)(const byte* payload, unsigned int length))
+{
+  rawSubscriber[topic] = receiver;
+  if (mqttClient.connected())
+  {
+    mqttClient.subscribe(topic);
+  }
+}
+
+/**
+ * set max. MQTT message size (default 256 bytes)
+ *
+ * note: must not be called from a subscriber
+ */
+void MQTTClient::setBufferSize(uint16 size)
+{
+  mqttClient.setBufferSize(size);
 }
 
 bool MQTTClient::isConnected()
@@ -150,6 +248,14 @@ bool MQTTClient::isConnected()
   return mqttClient.connected();
 }
 
+/**
+ * @return [µs] arrival time of last received MQTT message
+ */
+uint32 MQTTClient::getReceiveTime() const
+{
+  return receiveTime;
+}
+
 /**
  * publish on change of payload
  *
@@ -178,12 +284,121 @@ bool MQTTClient::publish(const char* topic, const String& message, bool retain,
     // publish on change
     if (mqttClient.connected() && (changed || force))
     {
-      bool published = mqttClient.publish(topic, message.c_str(), retain);
-      if (published && changed)
+      bool success = mqttClient.publish(topic, message.c_str(), retain);
+      if (success)
       {
-        publications[topic] = message;
+        published.inc();
+        if (changed)
+        {
+          publications[topic] = message;
+        }
       }
-      return published;
+      return success;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * publish on change of PROGMEM payload
+ *
+ * @param topic
+ * @param payload PROGMEM string
+ * @param retain
+ * @param force
+ * @return true if published
+ */
+bool MQTTClient::publish_P(const char* topic, PGM_P payload, bool retain, bool force)
+{
+  if (lastConnectTime)
+  {
+    // payload change detection
+    auto i = publications.find(topic);
+    bool changed;
+    if (i != publications.end())
+    {
+      changed = strcmp_P(i->second.c_str(), payload) != 0;
+    }
+    else
+    {
+      changed = true;
+    }
+
+    // publish on change
+    if (mqttClient.connected() && (changed || force))
+    {
+      bool success = mqttClient.publish_P(topic, payload, retain);
+      if (success)
+      {
+        published.inc();
+        if (changed)
+        {
+          publications[topic] = FPSTR(payload);
+        }
+      }
+      return success;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * publish binary chunk prefixed with its offset (32 bit little endian)
+ * without change detection
+ *
+ * note: payload size is not limited by the MQTT buffer size
+ *
+ * @param topic
+ * @param offset
+ * @param data
+ * @param length
+ * @return true if published
+ */
+bool MQTTClient::publish(const char* topic, uint32 offset, const byte* data, unsigned int length)
+{
+  if (mqttClient.connected() && mqttClient.beginPublish(topic, sizeof(offset) + length, false))
+  {
+    const byte prefix[] = { (byte)offset, (byte)(offset >> 8), (byte)(offset >> 16), (byte)(offset >> 24) };
+    mqttClient.write(prefix, sizeof(prefix));
+    mqttClient.write(data, length);
+    if (mqttClient.endPublish())
+    {
+      published.inc();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * publish payload written by callback without change detection
+ *
+ * note: payload size is not limited by the MQTT buffer size, the callback
+ *       is called twice and must write the same payload each time
+ *
+ * @param topic
+ * @param writer
+ * @return true if published
+ */
+bool MQTTClient::publish(const char* topic, const std::function<void (Print&)>& writer)
+{
+  if (!mqttClient.connected())
+  {
+    return false;
+  }
+
+  PrintLength length;
+  writer(length);
+  if (mqttClient.beginPublish(topic, length.get(), false))
+  {
+    writer(mqttClient);
+    if (mqttClient.endPublish())
+    {
+      published.inc();
+      return true;
     }
   }
 
@@ -32,6 +32,7 @@
 
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
+#include "Metrics.h"
 
 
 /**
@@ -46,12 +47,20 @@ public:
   void addMetadata(const char* topic, const char* message);
   void addSubscriber(const char* topic, void (*setter)(bool value));
   void addSubscriber(const char* topic, void (*setter)(int value));
+  void addSubscriber(const char* topic, void (*receiver)(const byte* payload, unsigned int length));
+
+  void setBufferSize(uint16 size);
 
   void setup(const char* mqttServer, uint16 mqttPort, const char* mqttUsername, const char* mqttPassword,const char* clientId, const char* willTopic, const char* willMessage);
+  void setClientId(const char* clientId);
   void loop();
 
   bool isConnected();
+  uint32 getReceiveTime() const;
   bool publish(const char* topic, const String& payload, bool retain=false, bool force=false);
+  bool publish_P(const char* topic, PGM_P payload, bool retain=false, bool force=false);
+  bool publish(const char* topic, uint32 offset, const byte* data, unsigned int length);
+  bool publish(const char* topic, const std::function<void (Print&)>& writer);
 
 private:
   static const unsigned int RECONNECT_DELAY = 3000; // [ms]
@@ -66,22 +75,41 @@ private:
 private:
   PubSubClient mqttClient;
   WiFiClient wifiClient;
-  const char* clientId;
+  const char* clientId = nullptr;
   const char* willTopic;
   const char* willMessage;
   const char* mqttuser;
   const char* mqttpw;
 
+private:
+  // topic order supporting lookup by C string without temporary String
+  struct TopicLess
+  {
+    using is_transparent = void;
+    bool operator()(const String& a, const String& b) const { return strcmp(a.c_str(), b.c_str()) < 0; }
+    bool operator()(const String& a, const char* b) const   { return strcmp(a.c_str(), b) < 0; }
+    bool operator()(const char* a, const String& b) const   { return strcmp(a, b.c_str()) < 0; }
+  };
+
 private:
   std::map<String, String> metadata;
-  std::map<String, String> publications;
+  std::map<String, String, TopicLess> publications;
 
   std::map<String, std::function<void (bool)>> boolSubscriber;
   std::map<String, std::function<void (int)>> intSubscriber;
+  std::map<String, std::function<void (const byte*, unsigned int)>> rawSubscriber;
 
 private:
   unsigned int now;
   unsigned int lastConnectTime = 0;
+  uint32 receiveTime = 0;
+
+private:
+  // metrics
+  static Metrics::Counter connects;
+  static Metrics::Counter connectFailures;
+  static Metrics::Counter published;
+  static Metrics::Counter received;
 };
 
 #endif /* MQTT_CLIENT_H */
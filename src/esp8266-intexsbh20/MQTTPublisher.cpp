@@ -26,12 +26,26 @@
 
 #include "MQTTPublisher.h"
 
+#include "HeapTracker.h"
 #include "MQTTClient.h"
 #include "PureSpaIO.h"
 #include "NTCThermometer.h"
 #include "common.h"
 
 
+namespace WIFI_METRIC
+{
+  const char UPTIME[]  PROGMEM = "wifi_uptime_s";
+  const char RSSI[]    PROGMEM = "wifi_rssi_dbm";
+  const char IDLE[]    PROGMEM = "wifi_idle";
+  const char WAKEUPS[] PROGMEM = "wifi_wakeups_per_min";
+}
+
+Metrics::Gauge MQTTPublisher::uptime(WIFI_METRIC::UPTIME);
+Metrics::Gauge MQTTPublisher::rssi(WIFI_METRIC::RSSI);
+Metrics::Gauge MQTTPublisher::idleGauge(WIFI_METRIC::IDLE);
+Metrics::Gauge MQTTPublisher::wakeupRate(WIFI_METRIC::WAKEUPS);
+
 MQTTPublisher::MQTTPublisher(MQTTClient& mqttClient, PureSpaIO& pureSpaIO, NTCThermometer& thermometer) :
   mqttClient(mqttClient),
   pureSpaIO(pureSpaIO),
@@ -53,6 +67,58 @@ bool MQTTPublisher::isRetainAll() const
   return retainAll;
 }
 
+/**
+ * reduce the forced publish rate to the idle heartbeat
+ */
+void MQTTPublisher::setIdle(bool idle)
+{
+  this->idle = idle;
+  idleGauge.set(idle);
+}
+
+/**
+ * update rate of main loop wakeups
+ *
+ * @param passes total number of main loop passes
+ */
+void MQTTPublisher::updateWakeups(uint32 passes)
+{
+  unsigned long now = millis();
+  unsigned long elapsed = timeDiff(now, wakeupTime);
+  if (elapsed)
+  {
+    wakeupRate.set((uint64_t)(passes - lastPasses)*60000/elapsed);
+  }
+  wakeupTime = now;
+  lastPasses = passes;
+}
+
+/**
+ * @return true if the pool state has been published at least once
+ */
+bool MQTTPublisher::isPoolPublished() const
+{
+  return poolPublished;
+}
+
+/**
+ * @return [µs] time of last publish of pool state
+ */
+uint32 MQTTPublisher::getPoolPublishTime() const
+{
+  return poolPublishTime;
+}
+
+/**
+ * request publishing of all metrics in Prometheus text format
+ *
+ * note: may be called from a subscriber, publishing is deferred to loop()
+ */
+void MQTTPublisher::requestMetrics()
+{
+  metricsRequested = true;
+}
+
 void MQTTPublisher::publishIfDefined(const char* topic, uint8 b, uint8 undef)
 {
   if (b != undef)
@@ -104,19 +170,114 @@ void MQTTPublisher::publishTemp(const char* topic, float t)
   }
 }
 
+/**
+ * publish completed capture of raw frames in chunks and release capture buffer
+ *
+ * 'wifi/capture/data': chunks of captured frames in chronological order, each
+ * chunk prefixed with the index of its first frame (32 bit little endian), each
+ * frame with 16 bit frame value and 16 bit time since previous frame [µs]
+ * (little endian)
+ *
+ * 'wifi/capture': JSON summary published after the last chunk, with "error"
+ * if the capture buffer could not be allocated
+ */
+void MQTTPublisher::publishCapture()
+{
+  unsigned int frames = 0;
+  unsigned int first = 0;
+  unsigned int size = 0;
+  const uint32* data = pureSpaIO.getCapture(frames, first, size);
+  bool failed = !data;
+  bool success = !failed;
+  for (unsigned int i=0; i<frames && success; )
+  {
+    // chunks end at the wrap around of the ring
+    unsigned int index = (first + i) % size;
+    unsigned int chunkFrames = (frames - i) < CAPTURE_CHUNK_FRAMES? (frames - i) : CAPTURE_CHUNK_FRAMES;
+    chunkFrames = (size - index) < chunkFrames? (size - index) : chunkFrames;
+    success = mqttClient.publish(MQTT_TOPIC::CAPTURE_DATA, i, (const byte*)(data + index), chunkFrames*sizeof(uint32));
+    i += chunkFrames;
+    ESP.wdtFeed();
+  }
+  pureSpaIO.stopCapture();
+
+  char summary[96];
+  snprintf_P(summary, sizeof(summary), PSTR("{\"model\":%d,\"frames\":%u,\"complete\":%s%s}"), pureSpaIO.getModel(), frames,
+             success? "true" : "false", failed? ",\"error\":\"out of memory\"" : "");
+  mqttClient.publish(MQTT_TOPIC::CAPTURE, summary, false, true);
+}
+
+#ifdef ISR_PROFILING
+static size_t printProfile(Print& out, const PureSpaIO::Profile& profile)
+{
+  static const char* const TYPE_NAMES[PureSpaIO::PROFILE::PROFILE_TYPES] = { "bit", "cue", "digit", "led", "button", "other", "reply", "pulse", "exit" };
+
+  size_t n = out.printf_P(PSTR("{\"budget\":%u,\"over\":%u"), PureSpaIO::BUDGET_CYCLES, profile.overBudget);
+  for (unsigned int i=0; i<PureSpaIO::PROFILE::PROFILE_TYPES; i++)
+  {
+    const PureSpaIO::ProfileStats& stats = profile.stats[i];
+    n += out.printf_P(PSTR(",\"%s\":[%u,%u,%u]"), TYPE_NAMES[i],
+                      stats.count, stats.count? (uint32)(stats.sum/stats.count) : 0, stats.max);
+  }
+  n += out.print('}');
+  return n;
+}
+
+/**
+ * publish ISR statistics since last call as JSON
+ *
+ * format: {"budget":<cycles per clock period>,"over":<ISR calls exceeding budget>,
+ *          "<type>":[<ISR calls>,<avg cycles>,<max cycles>],...}
+ */
+void MQTTPublisher::publishProfile()
+{
+  PureSpaIO::Profile profile;
+  pureSpaIO.getProfile(profile);
+
+  // stream JSON, size is not limited by a buffer
+  mqttClient.publish(MQTT_TOPIC::ISR_PROFILE, [&profile](Print& out) -> void { printProfile(out, profile); });
+}
+#endif
+
+/**
+ * update metrics of WiFi controller and publish all metrics
+ *
+ * @param topic
+ * @param format
+ */
+void MQTTPublisher::publishMetrics(const char* topic, Metrics::FORMAT format)
+{
+  uptime.set(micros64()/1000000);
+  HeapTracker::sample();
+
+  mqttClient.publish(topic, [format](Print& out) -> void { Metrics::print(out, format); });
+}
+
 /**
  * publish changed topics with rate limit
  * except topic 'wifi/state' that is force published ever 10 seconds
+ * and immediately after connecting to the MQTT server or a change of the
+ * pool state
  */
 void MQTTPublisher::loop()
 {
   unsigned long now = millis();
-  if (timeDiff(now, poolUpdateTime) >= CONFIG::POOL_UPDATE_PERIOD)
+
+  // publish immediately after (re)connect
+  bool wasConnected = connected;
+  connected = mqttClient.isConnected();
+  bool reconnected = connected && !wasConnected;
+
+  // publish immediately on change of pool state
+  bool changed = pureSpaIO.clearStateChanged();
+
+  if (reconnected || changed || timeDiff(now, poolUpdateTime) >= CONFIG::POOL_UPDATE_PERIOD)
   {
     poolUpdateTime = now;
 
     bool forcedStateUpdate = false;
-    if (timeDiff(now, poolStateUpdateTime) >= CONFIG::FORCED_STATE_UPDATE_PERIOD)
+    unsigned long forcedPeriod = idle? CONFIG::IDLE_HEARTBEAT_PERIOD : CONFIG::FORCED_STATE_UPDATE_PERIOD;
+    if (reconnected || timeDiff(now, poolStateUpdateTime) >= forcedPeriod)
     {
       poolStateUpdateTime = now;
       forcedStateUpdate = true;
@@ -147,8 +308,8 @@ void MQTTPublisher::loop()
       publishIfDefined("pool/telegram/led", pureSpaIO.getRawLedValue(), PureSpaIO::UNDEF::USHORT);
 #endif
 
-      String errorCode = pureSpaIO.getErrorCode();
-      if (errorCode.length())
+      uint32 errorCode = pureSpaIO.getErrorCode();
+      if (errorCode != PureSpaIO::ERROR_NONE)
       {
         mqttClient.publish(MQTT_TOPIC::STATE, "error", retainAll, forcedStateUpdate);
       }
@@ -156,15 +317,47 @@ void MQTTPublisher::loop()
       {
         mqttClient.publish(MQTT_TOPIC::STATE, "online", retainAll, forcedStateUpdate);
       }
-      mqttClient.publish(MQTT_TOPIC::ERROR, pureSpaIO.getErrorMessage(errorCode).c_str(), retainAll);
+      const char* errorMessage = pureSpaIO.getErrorMessage(errorCode);
+      if (errorMessage || errorCode == PureSpaIO::ERROR_NONE)
+      {
+        mqttClient.publish_P(MQTT_TOPIC::ERROR, errorMessage? errorMessage : PSTR(""), retainAll);
+      }
+      else
+      {
+        // undefined error, publish code
+        char code[4];
+        memcpy(code, &errorCode, sizeof(code));
+        code[3] = 0;
+        mqttClient.publish(MQTT_TOPIC::ERROR, code, retainAll);
+      }
+
+      poolPublished = poolPublished || mqttClient.isConnected();
+      if (mqttClient.isConnected())
+      {
+        poolPublishTime = micros();
+      }
     }
     else
     {
       mqttClient.publish(MQTT_TOPIC::STATE, "offline", retainAll, forcedStateUpdate);
     }
+    mqttClient.publish_P(MQTT_TOPIC::BUS, pureSpaIO.getBusHealthName(), retainAll);
+
+    // publish metrics on request
+    if (metricsRequested)
+    {
+      metricsRequested = false;
+      publishMetrics(MQTT_TOPIC::METRICS_TEXT, Metrics::FORMAT::PROMETHEUS);
+    }
+
+    // publish completed capture
+    if (pureSpaIO.isCaptureComplete() || pureSpaIO.isCaptureFailed())
+    {
+      publishCapture();
+    }
 
     // update WiFi controller temperature and RSSI
-    if (timeDiff(now, wifiStateUpdateTime) >= CONFIG::WIFI_UPDATE_PERIOD)
+    if (timeDiff(now, wifiStateUpdateTime) >= (idle? CONFIG::IDLE_HEARTBEAT_PERIOD : CONFIG::WIFI_UPDATE_PERIOD))
     {
       wifiStateUpdateTime = now;
 
@@ -172,11 +365,19 @@ void MQTTPublisher::loop()
       publishTemp(MQTT_TOPIC::WIFI_TEMP, thermometer.getTemperature());
 
       // get WiFi RSSI
-      publish(MQTT_TOPIC::RSSI, WiFi.RSSI());
+      int wifiRSSI = WiFi.RSSI();
+      rssi.set(wifiRSSI);
+      publish(MQTT_TOPIC::RSSI, wifiRSSI);
 
 #ifdef SERIAL_DEBUG
       publish("wifi/heap", ESP.getFreeHeap());
 #endif
+
+#ifdef ISR_PROFILING
+      publishProfile();
+#endif
+
+      publishMetrics(MQTT_TOPIC::METRICS, Metrics::FORMAT::JSON);
     }
   }
 }
@@ -28,6 +28,8 @@
 #define MQTT_PUBLISHER_H
 
 #include <c_types.h>
+#include "common.h"
+#include "Metrics.h"
 
 class MQTTClient;
 class PureSpaIO;
@@ -42,12 +44,18 @@ public:
 public:
   void setRetainAll(bool retain);
   bool isRetainAll() const;
+  bool isPoolPublished() const;
+  uint32 getPoolPublishTime() const;
+  void requestMetrics();
+  void setIdle(bool idle);
+  void updateWakeups(uint32 passes);
 
 public:
   void loop();
 
 private:
   static const unsigned int BUFFER_SIZE = 16;
+  static const unsigned int CAPTURE_CHUNK_FRAMES = 256; // frames per MQTT message
 
 private:
   void publish(const char* topic, int i);
@@ -58,19 +66,37 @@ private:
   void publishIfDefined(const char* topic, int i, int undef);
 
   void publishTemp(const char* topic, float t);
+  void publishCapture();
+  void publishMetrics(const char* topic, Metrics::FORMAT format);
+#ifdef ISR_PROFILING
+  void publishProfile();
+#endif
 
 private:
   MQTTClient& mqttClient;
   PureSpaIO& pureSpaIO;
   NTCThermometer& thermometer;
   bool retainAll;
+  bool poolPublished = false;
+  bool connected = false;
+  bool metricsRequested = false;
+  uint32 poolPublishTime = 0;
+  bool idle = false;
 
 private:
   unsigned long poolUpdateTime = 0;
   unsigned long poolStateUpdateTime = 0;
   unsigned long wifiStateUpdateTime = 0;
+  unsigned long wakeupTime = 0;
+  uint32 lastPasses = 0;
   char buf[BUFFER_SIZE];
 
+private:
+  // metrics
+  static Metrics::Gauge uptime;
+  static Metrics::Gauge rssi;
+  static Metrics::Gauge idleGauge;
+  static Metrics::Gauge wakeupRate;
 };
 
 #endif /* MQTT_PUBLISHER_H */
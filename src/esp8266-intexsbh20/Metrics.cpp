@@ -0,0 +1,210 @@
+/*
+ * project:  generic
+ *
+ * file:     Metrics.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#include "Metrics.h"
+
+#include <pgmspace.h>
+
+
+Metrics::Metric* Metrics::first = nullptr;
+Metrics::Metric* Metrics::last = nullptr;
+
+
+/**
+ * append metric to registry
+ *
+ * @param name metric name in PROGMEM
+ * @param type
+ */
+Metrics::Metric::Metric(const char* name, TYPE type) :
+  name(name),
+  type(type)
+{
+  if (last)
+  {
+    last->next = this;
+  }
+  else
+  {
+    first = this;
+  }
+  last = this;
+}
+
+/**
+ * @param name metric name in PROGMEM
+ * @param bounds ascending upper bounds of buckets (inclusive)
+ * @param size number of bounds
+ * @param buckets size + 1 counters
+ */
+Metrics::Histogram::Histogram(const char* name, const uint32* bounds, unsigned int size, uint32* buckets) :
+  Metric(name, TYPE::HISTOGRAM),
+  bounds(bounds),
+  buckets(buckets),
+  size(size)
+{
+}
+
+void Metrics::Histogram::observe(uint32 value)
+{
+  unsigned int i = 0;
+  while (i < size && value > bounds[i])
+  {
+    i++;
+  }
+  buckets[i]++;
+  count++;
+  sum += value;
+}
+
+/**
+ * export all metrics
+ *
+ * JSON: {"<name>":<value>,...}, histograms as [<count>,<sum>,<bucket 0>,...,<overflow bucket>]
+ *
+ * PROMETHEUS: text exposition format with cumulative histogram buckets
+ *
+ * @param out
+ * @param format
+ * @return number of bytes written
+ */
+size_t Metrics::print(Print& out, FORMAT format)
+{
+  size_t n = 0;
+  if (format == FORMAT::JSON)
+  {
+    n += out.print('{');
+    for (const Metric* m = first; m; m = m->next)
+    {
+      if (m != first)
+      {
+        n += out.print(',');
+      }
+      n += printJSON(out, *m);
+    }
+    n += out.print('}');
+  }
+  else
+  {
+    for (const Metric* m = first; m; m = m->next)
+    {
+      n += printPrometheus(out, *m);
+    }
+  }
+
+  return n;
+}
+
+size_t Metrics::printJSON(Print& out, const Metric& metric)
+{
+  size_t n = out.print('"');
+  n += out.print(FPSTR(metric.name));
+  n += out.print(F("\":"));
+  switch (metric.type)
+  {
+    case TYPE::COUNTER:
+      n += out.print(static_cast<const Counter&>(metric).get());
+      break;
+
+    case TYPE::GAUGE:
+      n += out.print(static_cast<const Gauge&>(metric).get());
+      break;
+
+    case TYPE::HISTOGRAM:
+    {
+      const Histogram& h = static_cast<const Histogram&>(metric);
+      n += out.print('[');
+      n += out.print(h.count);
+      n += out.print(',');
+      n += out.print(h.sum);
+      for (unsigned int i=0; i<=h.size; i++)
+      {
+        n += out.print(',');
+        n += out.print(h.buckets[i]);
+      }
+      n += out.print(']');
+      break;
+    }
+  }
+
+  return n;
+}
+
+size_t Metrics::printPrometheus(Print& out, const Metric& metric)
+{
+  static const char* const TYPE_NAMES[] = { "counter", "gauge", "histogram" };
+
+  size_t n = out.print(F("# TYPE "));
+  n += out.print(FPSTR(metric.name));
+  n += out.print(' ');
+  n += out.println(TYPE_NAMES[metric.type]);
+  switch (metric.type)
+  {
+    case TYPE::COUNTER:
+      n += out.print(FPSTR(metric.name));
+      n += out.print(' ');
+      n += out.println(static_cast<const Counter&>(metric).get());
+      break;
+
+    case TYPE::GAUGE:
+      n += out.print(FPSTR(metric.name));
+      n += out.print(' ');
+      n += out.println(static_cast<const Gauge&>(metric).get());
+      break;
+
+    case TYPE::HISTOGRAM:
+    {
+      const Histogram& h = static_cast<const Histogram&>(metric);
+      uint32 cumulative = 0;
+      for (unsigned int i=0; i<=h.size; i++)
+      {
+        cumulative += h.buckets[i];
+        n += out.print(FPSTR(metric.name));
+        n += out.print(F("_bucket{le=\""));
+        if (i < h.size)
+        {
+          n += out.print(h.bounds[i]);
+        }
+        else
+        {
+          n += out.print(F("+Inf"));
+        }
+        n += out.print(F("\"} "));
+        n += out.println(cumulative);
+      }
+      n += out.print(FPSTR(metric.name));
+      n += out.print(F("_sum "));
+      n += out.println(h.sum);
+      n += out.print(FPSTR(metric.name));
+      n += out.print(F("_count "));
+      n += out.println(h.count);
+      break;
+    }
+  }
+
+  return n;
+}
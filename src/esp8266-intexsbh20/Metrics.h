@@ -0,0 +1,150 @@
+/*
+ * project:  generic
+ *
+ * file:     Metrics.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Print.h>
+
+
+/**
+ * Registry of statically allocated metrics (counters, gauges and histograms
+ * with fixed buckets).
+ *
+ * Metrics are defined as static objects and register themselves on
+ * construction, so neither registration nor collection allocates memory.
+ * Metric names must be stored in PROGMEM. Updates are not atomic and must
+ * not be performed from an ISR.
+ *
+ * The registry can be exported as compact JSON or in the text format of
+ * Prometheus to any Print instance.
+ */
+class Metrics
+{
+public:
+  enum TYPE
+  {
+    COUNTER = 0,
+    GAUGE,
+    HISTOGRAM
+  };
+
+  enum FORMAT
+  {
+    JSON = 0,
+    PROMETHEUS
+  };
+
+public:
+  class Metric
+  {
+  protected:
+    Metric(const char* name, TYPE type);
+
+  private:
+    friend class Metrics;
+    const char* name;
+    TYPE type;
+    Metric* next = nullptr;
+  };
+
+  /**
+   * monotonic value
+   */
+  class Counter : public Metric
+  {
+  public:
+    Counter(const char* name) : Metric(name, TYPE::COUNTER) {}
+
+  public:
+    void inc(uint32 n = 1) { value += n; }
+    void set(uint32 v)     { value = v; } // for monotonic values counted elsewhere
+    uint32 get() const     { return value; }
+
+  private:
+    uint32 value = 0;
+  };
+
+  /**
+   * current value
+   */
+  class Gauge : public Metric
+  {
+  public:
+    Gauge(const char* name) : Metric(name, TYPE::GAUGE) {}
+
+  public:
+    void set(sint32 v) { value = v; }
+    sint32 get() const { return value; }
+
+  private:
+    sint32 value = 0;
+  };
+
+  /**
+   * distribution of values in buckets with ascending upper bounds and an
+   * additional overflow bucket, use FixedHistogram to define
+   */
+  class Histogram : public Metric
+  {
+  protected:
+    Histogram(const char* name, const uint32* bounds, unsigned int size, uint32* buckets);
+
+  public:
+    void observe(uint32 value);
+
+  private:
+    friend class Metrics;
+    const uint32* bounds;
+    uint32* buckets;
+    unsigned int size;
+    uint32 count = 0;
+    uint32 sum = 0;
+  };
+
+  template<unsigned int N> class FixedHistogram : public Histogram
+  {
+  public:
+    FixedHistogram(const char* name, const uint32 (&bounds)[N]) : Histogram(name, bounds, N, buckets) {}
+
+  private:
+    uint32 buckets[N + 1] = {};
+  };
+
+public:
+  static size_t print(Print& out, FORMAT format);
+
+private:
+  static size_t printJSON(Print& out, const Metric& metric);
+  static size_t printPrometheus(Print& out, const Metric& metric);
+
+private:
+  static Metric* first;
+  static Metric* last;
+};
+
+#endif /* METRICS_H */
@@ -32,6 +32,10 @@
 // set ADC to read from input pin A0
 ADC_MODE(ADC_TOUT)
 
+const char NTC_METRIC_TEMPERATURE[] PROGMEM = "ntc_temp_celsius";
+
+Metrics::Gauge NTCThermometer::temperature(NTC_METRIC_TEMPERATURE);
+
 /**
  * @param refResistance resistance between NTC and GND [Ohm]
  * @param refVoltage voltage at NTC [V]
@@ -108,5 +112,8 @@ float NTCThermometer::getTemperature()
     sum += history[i];
   }
 
-  return sum/historyDepth;
+  float average = sum/historyDepth;
+  temperature.set(lround(average));
+
+  return average;
 }
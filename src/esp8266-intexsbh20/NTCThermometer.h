@@ -27,6 +27,7 @@
 #ifndef NTC_THERMOMETER_H
 #define NTC_THERMOMETER_H
 
+#include "Metrics.h"
 
 class NTCThermometer
 {
@@ -54,6 +55,10 @@ private:
   float history[HISTORY_DEPTH];
   unsigned int historyDepth = 0;
   unsigned int historyHead = 0;
+
+private:
+  // metrics
+  static Metrics::Gauge temperature;
 };
 
 #endif /* NTC_THERMOMETER_H */
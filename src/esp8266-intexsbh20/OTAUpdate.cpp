@@ -26,41 +26,363 @@
 
 #include "OTAUpdate.h"
 
-#include <ESP8266httpUpdate.h>
+#include <algorithm>
+#include <ArduinoJson.h>
+#include <ESP8266HTTPClient.h>
 #include "MQTTClient.h"
 #include "common.h"
 
 
+// first byte of gzip compressed image
+const uint8 GZIP_MAGIC = 0x1F;
+
+const char OTA_METRIC_FAILURES[] PROGMEM = "ota_failures_total";
+
+Metrics::Counter OTAUpdate::failures(OTA_METRIC_FAILURES);
+
+/**
+ * perform OTA update via HTTP download (blocking)
+ *
+ * @param updateURL
+ * @param mqttClient
+ * @return true on success, will restart ESP8266
+ */
 bool OTAUpdate::start(const char* updateURL, MQTTClient& mqttClient)
 {
-  bool success = false;
+  if (isStreaming())
+  {
+    return false;
+  }
 
   mqttClient.publish(MQTT_TOPIC::OTA, F("in progress"), false, true);
 
-  // try to perform OTA update
+  // request image
   WiFiClient client;
-  t_httpUpdate_return ret = ESPhttpUpdate.update(client, updateURL, CONFIG::WIFI_VERSION);
-  const unsigned int BUFFER_SIZE = 128;
-  char buf[BUFFER_SIZE];
-  switch (ret)
+  HTTPClient http;
+  const char* headerKeys[] = { "x-MD5" };
+  http.begin(client, updateURL);
+  http.setTimeout(HTTP_TIMEOUT);
+  http.addHeader(F("x-ESP8266-version"), CONFIG::WIFI_VERSION);
+  http.collectHeaders(headerKeys, 1);
+  int httpCode = http.GET();
+  int size = http.getSize();
+  char buf[STATUS_BUFFER_SIZE];
+  if (httpCode == HTTP_CODE_NOT_MODIFIED)
+  {
+    mqttClient.publish(MQTT_TOPIC::OTA, F("none available"), false, true);
+  }
+  else if (httpCode != HTTP_CODE_OK)
+  {
+    snprintf_P(buf, STATUS_BUFFER_SIZE, PSTR("HTTP error %d"), httpCode);
+    publishFailure(buf, mqttClient);
+  }
+  else if (size <= 0)
+  {
+    publishFailure("image size unknown", mqttClient);
+  }
+  else if (!beginImage(size, http.header(headerKeys[0]).c_str()))
+  {
+    publishFailure(Update.hasError()? Update.getErrorString().c_str() : "out of memory", mqttClient);
+  }
+  else
   {
-    case HTTP_UPDATE_FAILED:
-      snprintf_P(buf, BUFFER_SIZE, PSTR("failed: %s (error code %d)"), ESPhttpUpdate.getLastErrorString().c_str(), ESPhttpUpdate.getLastError());
-      break;
+    // download image
+    WiFiClient* stream = http.getStreamPtr();
+    lastChunkTime = millis();
+    while (receivedSize < imageSize && timeDiff(millis(), lastChunkTime) < HTTP_TIMEOUT)
+    {
+      ESP.wdtFeed();
+      size_t available = stream->available();
+      if (available)
+      {
+        uint8 chunk[HTTP_CHUNK_SIZE];
+        size_t length = std::min({ available, (size_t)(imageSize - receivedSize), sizeof(chunk) });
+        length = stream->readBytes(chunk, length);
+        if (!writeImage(chunk, length))
+        {
+          break;
+        }
+        lastChunkTime = millis();
+      }
+      else
+      {
+        delay(1);
+      }
 
-    case HTTP_UPDATE_NO_UPDATES:
-      snprintf_P(buf, BUFFER_SIZE, PSTR("none available"));
-      break;
+      if (timeDiff(millis(), lastProgressTime) >= PROGRESS_PERIOD)
+      {
+        lastProgressTime = millis();
+        publishProgress(mqttClient);
+      }
+    }
 
-    case HTTP_UPDATE_OK:
-      snprintf_P(buf, BUFFER_SIZE, PSTR("success"));
-      success = true;
-      break;
+    // verify and commit image
+    if (receivedSize < imageSize)
+    {
+      discardImage();
+      publishFailure(Update.hasError()? Update.getErrorString().c_str() : "download incomplete", mqttClient);
+    }
+    else if (!endImage())
+    {
+      publishFailure(Update.getErrorString().c_str(), mqttClient);
+    }
+    else
+    {
+      publishSuccess(mqttClient);
+      delay(100);
+      ESP.restart();
+      return true;
+    }
+  }
+  http.end();
+
+  return false;
+}
+
+/**
+ * start OTA update via MQTT stream
+ *
+ * @param payload JSON {"size":<bytes>,"md5":"<hex>"}
+ * @param length payload length
+ * @param mqttClient
+ */
+void OTAUpdate::beginStream(const byte* payload, unsigned int length, MQTTClient& mqttClient)
+{
+  // parse payload before publishing, publishing will overwrite payload
+  StaticJsonDocument<128> doc;
+  DeserializationError error = deserializeJson(doc, payload, length);
+  uint32 size = error? 0 : (uint32)(doc["size"] | 0U);
+  char md5[33];
+  strlcpy(md5, error? "" : (const char*)(doc["md5"] | ""), sizeof(md5));
 
-    default:
-      snprintf_P(buf, BUFFER_SIZE, PSTR("unknown result: %d"), ret);
+  // cancel pending stream
+  if (isStreaming())
+  {
+    abortStream("restarted", mqttClient);
+  }
+
+  if (!size || strlen(md5) != 32)
+  {
+    publishFailure("invalid begin message", mqttClient);
+  }
+  else if (!beginImage(size, md5))
+  {
+    publishFailure(Update.hasError()? Update.getErrorString().c_str() : "out of memory", mqttClient);
+  }
+  else
+  {
+    streaming = true;
+    lastChunkTime = startTime;
+
+    mqttClient.publish(MQTT_TOPIC::OTA, F("in progress"), false, true);
+    mqttClient.publish(MQTT_TOPIC::OTA_OFFSET, String(receivedSize), false, true);
+  }
+}
+
+/**
+ * receive chunk of OTA update via MQTT stream
+ *
+ * @param payload 32 bit offset (little endian) followed by image data
+ * @param length payload length
+ * @param mqttClient
+ */
+void OTAUpdate::writeStream(const byte* payload, unsigned int length, MQTTClient& mqttClient)
+{
+  if (isStreaming() && length > 4)
+  {
+    uint32 offset = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32)payload[3] << 24);
+    const byte* data = payload + 4;
+    unsigned int dataLength = length - 4;
+    if (offset == receivedSize && dataLength <= STREAM_CHUNK_SIZE && receivedSize + dataLength <= imageSize)
+    {
+      if (!writeImage(data, dataLength))
+      {
+        abortStream(Update.getErrorString().c_str(), mqttClient);
+        return;
+      }
+      lastChunkTime = millis();
+    }
+    // else unexpected chunk, discard
+
+    if (receivedSize == imageSize)
+    {
+      endStream(mqttClient);
+    }
+    else
+    {
+      // request next chunk
+      mqttClient.publish(MQTT_TOPIC::OTA_OFFSET, String(receivedSize), false, true);
+    }
+  }
+}
+
+bool OTAUpdate::isStreaming() const
+{
+  return streaming;
+}
+
+/**
+ * publish OTA stream progress and detect stream timeout
+ */
+void OTAUpdate::loop(MQTTClient& mqttClient)
+{
+  if (isStreaming())
+  {
+    unsigned long now = millis();
+    if (timeDiff(now, lastChunkTime) > STREAM_TIMEOUT)
+    {
+      abortStream("timeout", mqttClient);
+    }
+    else if (timeDiff(now, lastProgressTime) >= PROGRESS_PERIOD)
+    {
+      lastProgressTime = now;
+      publishProgress(mqttClient);
+    }
+  }
+}
+
+/**
+ * prepare flash for image
+ *
+ * @param size image size [bytes]
+ * @param md5 MD5 checksum of image as hex string, empty if unknown
+ * @return true on success
+ */
+bool OTAUpdate::beginImage(uint32 size, const char* md5)
+{
+  if (Update.begin(size) && (!strlen(md5) || Update.setMD5(md5)))
+  {
+    imageSize = size;
+    receivedSize = 0;
+    header = 0;
+    memset(trailer, 0, sizeof(trailer));
+    startTime = lastProgressTime = millis();
+    return true;
+  }
+  else
+  {
+    discardImage();
+    return false;
+  }
+}
+
+/**
+ * remember first and last 4 bytes of image
+ *
+ * note: must be called before receivedSize is updated
+ */
+void OTAUpdate::trackImage(const uint8* data, unsigned int length)
+{
+  if (receivedSize == 0 && length)
+  {
+    header = data[0];
+  }
+
+  // gzip trailer contains uncompressed size
+  for (unsigned int i = length > sizeof(trailer)? length - sizeof(trailer) : 0; i < length; i++)
+  {
+    memmove(trailer, trailer + 1, sizeof(trailer) - 1);
+    trailer[sizeof(trailer) - 1] = data[i];
+  }
+}
+
+/**
+ * pass image data to the updater, the updater writes full sectors to flash
+ *
+ * @return true on success
+ */
+bool OTAUpdate::writeImage(const uint8* data, unsigned int length)
+{
+  trackImage(data, length);
+  receivedSize += length;
+
+  return Update.write(const_cast<uint8*>(data), length) == length;
+}
+
+/**
+ * write remaining data and verify image
+ *
+ * @return true if image is ready to be installed
+ */
+bool OTAUpdate::endImage()
+{
+  bool success = Update.end();
+  if (!success)
+  {
+    discardImage();
   }
-  mqttClient.publish(MQTT_TOPIC::OTA, buf, false, true);
 
   return success;
 }
+
+void OTAUpdate::discardImage()
+{
+  if (Update.isRunning())
+  {
+    // image is incomplete, discard
+    Update.end();
+  }
+}
+
+/**
+ * verify image and restart on success
+ */
+void OTAUpdate::endStream(MQTTClient& mqttClient)
+{
+  streaming = false;
+  if (endImage())
+  {
+    publishSuccess(mqttClient);
+
+    // give MQTT time to send
+    delay(100);
+    ESP.restart();
+  }
+  else
+  {
+    publishFailure(Update.getErrorString().c_str(), mqttClient);
+  }
+}
+
+void OTAUpdate::abortStream(const char* reason, MQTTClient& mqttClient)
+{
+  streaming = false;
+  discardImage();
+  publishFailure(reason, mqttClient);
+}
+
+void OTAUpdate::publishProgress(MQTTClient& mqttClient)
+{
+  unsigned long elapsed = timeDiff(millis(), startTime);
+  uint32 rate = elapsed? receivedSize*1000ULL/elapsed : 0; // [bytes/s]
+  uint32 eta = rate? (imageSize - receivedSize)/rate : 0;  // [s]
+
+  char buf[STATUS_BUFFER_SIZE];
+  snprintf_P(buf, STATUS_BUFFER_SIZE, PSTR("progress %u %% (%u bytes/s, ETA %u s)"), receivedSize*100/imageSize, rate, eta);
+  mqttClient.publish(MQTT_TOPIC::OTA, buf, false, true);
+}
+
+/**
+ * publish transferred and installed image size and transfer duration
+ *
+ * note: the uncompressed size of a gzip image is taken from its trailer
+ */
+void OTAUpdate::publishSuccess(MQTTClient& mqttClient)
+{
+  bool compressed = header == GZIP_MAGIC;
+  uint32 uncompressedSize = compressed? trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32)trailer[3] << 24) : imageSize;
+
+  char buf[STATUS_BUFFER_SIZE];
+  snprintf_P(buf, STATUS_BUFFER_SIZE, PSTR("success (%s, %u bytes, uncompressed %u bytes, %lu ms)"),
+             compressed? "gzip" : "raw", imageSize, uncompressedSize, timeDiff(millis(), startTime));
+  mqttClient.publish(MQTT_TOPIC::OTA, buf, false, true);
+}
+
+void OTAUpdate::publishFailure(const char* reason, MQTTClient& mqttClient)
+{
+  failures.inc();
+
+  char buf[STATUS_BUFFER_SIZE];
+  snprintf_P(buf, STATUS_BUFFER_SIZE, PSTR("failed: %s"), reason);
+  mqttClient.publish(MQTT_TOPIC::OTA, buf, false, true);
+}
@@ -27,15 +27,89 @@
 #ifndef OTA_UPDATE_H
 #define OTA_UPDATE_H
 
+#include <c_types.h>
+#include "Metrics.h"
+
 class MQTTClient;
 
 
+/**
+ * OTA update via HTTP download or via MQTT stream
+ *
+ * The firmware image may be gzip compressed (e.g. firmware.bin.gz). Compressed
+ * images are written to the flash as is and will be decompressed by the
+ * bootloader while installing. If available the image is verified with its
+ * MD5 checksum before the update is committed.
+ *
+ * HTTP download:
+ *
+ * The MD5 checksum is taken from the optional HTTP response header 'x-MD5'.
+ * The server may respond with 304 if the version in the request header
+ * 'x-ESP8266-version' is up to date.
+ *
+ * MQTT stream protocol:
+ *
+ * 1. publish JSON {"size":<bytes>,"md5":"<hex>"} to 'wifi/command/update/begin'
+ * 2. publish chunks of max. STREAM_CHUNK_SIZE bytes to 'wifi/command/update/chunk',
+ *    each prefixed with the image offset of the chunk as 32 bit little endian value
+ * 3. after each chunk the offset of the next expected chunk is published to
+ *    'wifi/update/offset', chunks with an unexpected offset are discarded
+ *    and must be resent starting at the expected offset
+ * 4. after the last chunk the image is verified, the status is published
+ *    to 'wifi/update' and the ESP8266 is restarted
+ *
+ * The image is written to the flash in sector aligned blocks by the sector
+ * buffer of the updater.
+ */
 class OTAUpdate
 {
 public:
   bool start(const char* updateURL, MQTTClient& mqttClient);
 
+  void beginStream(const byte* payload, unsigned int length, MQTTClient& mqttClient);
+  void writeStream(const byte* payload, unsigned int length, MQTTClient& mqttClient);
+  bool isStreaming() const;
+
+  void loop(MQTTClient& mqttClient);
+
+public:
+  static const unsigned int STREAM_CHUNK_SIZE   = 1024; // [bytes] max. image data per chunk
+  static const unsigned int STREAM_MESSAGE_SIZE = STREAM_CHUNK_SIZE + 4 + 64; // [bytes] incl. offset, topic and MQTT header
+
+private:
+  static const unsigned int STREAM_TIMEOUT     = 30000; // [ms] max. time between chunks
+  static const unsigned int HTTP_TIMEOUT       = 10000; // [ms] max. time without receiving data
+  static const unsigned int PROGRESS_PERIOD    =  2000; // [ms]
+  static const unsigned int STATUS_BUFFER_SIZE =   128; // [bytes]
+  static const unsigned int HTTP_CHUNK_SIZE    =   256; // [bytes] max. image data per read
+
+private:
+  bool beginImage(uint32 size, const char* md5);
+  void trackImage(const uint8* data, unsigned int length);
+  bool writeImage(const uint8* data, unsigned int length);
+  bool endImage();
+  void discardImage();
+
+  void endStream(MQTTClient& mqttClient);
+  void abortStream(const char* reason, MQTTClient& mqttClient);
+
+  void publishProgress(MQTTClient& mqttClient);
+  void publishSuccess(MQTTClient& mqttClient);
+  void publishFailure(const char* reason, MQTTClient& mqttClient);
+
+private:
+  uint32 imageSize = 0;
+  uint32 receivedSize = 0;
+  uint8 header = 0;
+  uint8 trailer[4];
+  unsigned long startTime = 0;
+  unsigned long lastChunkTime = 0;
+  unsigned long lastProgressTime = 0;
+  bool streaming = false;
+
+private:
+  // metrics
+  static Metrics::Counter failures;
 };
 
 #endif /* OTA_UPDATE_H */
-
@@ -27,75 +27,131 @@
  */
 
 #include "PureSpaIO.h"
+#include "RadioPolicy.h"
 
 #include <ESP8266WiFi.h>
+#include <coredecls.h>
 
 
-#if defined MODEL_SB_H20
+/**
+ * frame bit masks specialised per model
+ *
+ * The ISR is instantiated per model so that all masks are compile time
+ * constants. Masks of functions a model does not have are 0.
+ */
+template<PureSpaIO::MODEL M> struct FRAME_LED;
+template<PureSpaIO::MODEL M> struct FRAME_BUTTON;
 
-#define DEFAULT_MODEL_NAME "Intex PureSpa SB-H20"
+template<> struct FRAME_LED<PureSpaIO::MODEL::SBH20>
+{
+  static const uint16 POWER          = 0x0001;
+  static const uint16 HEATER_ON      = 0x0080;  // max. 72 h, will start filter, will not stop filter
+  static const uint16 NO_BEEP        = 0x0100;
+  static const uint16 HEATER_STANDBY = 0x0200;
+  static const uint16 BUBBLE         = 0x0400;  // max. 30 min
+  static const uint16 FILTER         = 0x1000;  // max. 24 h
+  static const uint16 JET            = 0;
+  static const uint16 DISINFECTION   = 0;
+};
 
-// bit mask for LEDs
-namespace FRAME_LED
+template<> struct FRAME_BUTTON<PureSpaIO::MODEL::SBH20>
 {
-  const uint16 POWER          = 0x0001;
-  const uint16 HEATER_ON      = 0x0080;  // max. 72 h, will start filter, will not stop filter
-  const uint16 NO_BEEP        = 0x0100;
-  const uint16 HEATER_STANDBY = 0x0200;
-  const uint16 BUBBLE         = 0x0400;  // max. 30 min
-  const uint16 FILTER         = 0x1000;  // max. 24 h
-}
+  static const uint16 DISINFECTION = 0;
+  static const uint16 BUBBLE       = 0x0008;
+  static const uint16 JET          = 0;
+  static const uint16 FILTER       = 0x0002;
+  static const uint16 TEMP_DOWN    = 0x0080;
+  static const uint16 POWER        = 0x0400;
+  static const uint16 TEMP_UP      = 0x1000;
+  static const uint16 TEMP_UNIT    = 0x2000;
+  static const uint16 HEATER       = 0x8000;
+
+  static const uint16 TYPE = 0x0100 | POWER | FILTER | HEATER | BUBBLE | TEMP_UP | TEMP_DOWN | TEMP_UNIT;
+  static const unsigned int FRAMES = 7; // number of button frames in each cycle
+};
 
-// bit mask of button
-namespace FRAME_BUTTON
+template<> struct FRAME_LED<PureSpaIO::MODEL::SJBHS>
 {
-  const uint16 FILTER    = 0x0002;
-  const uint16 BUBBLE    = 0x0008;
-  const uint16 TEMP_DOWN = 0x0080;
-  const uint16 POWER     = 0x0400;
-  const uint16 TEMP_UP   = 0x1000;
-  const uint16 TEMP_UNIT = 0x2000;
-  const uint16 HEATER    = 0x8000;
-}
+  static const uint16 POWER          = 0x0001;
+  static const uint16 BUBBLE         = 0x0002;  // max. 30 min
+  static const uint16 HEATER_ON      = 0x0080;  // max. 72 h, will start filter, will not stop filter
+  static const uint16 NO_BEEP        = 0x0100;
+  static const uint16 HEATER_STANDBY = 0x0200;
+  static const uint16 JET            = 0x0400;
+  static const uint16 FILTER         = 0x1000;  // max. 24 h
+  static const uint16 DISINFECTION   = 0x2000;  // max. 8 h
+};
 
-#elif defined MODEL_SJB_HS
+template<> struct FRAME_BUTTON<PureSpaIO::MODEL::SJBHS>
+{
+  static const uint16 DISINFECTION = 0x0001;
+  static const uint16 BUBBLE       = 0x0002;
+  static const uint16 JET          = 0x0008;
+  static const uint16 FILTER       = 0x0080;
+  static const uint16 TEMP_DOWN    = 0x0200;
+  static const uint16 POWER        = 0x0400;
+  static const uint16 TEMP_UP      = 0x1000;
+  static const uint16 TEMP_UNIT    = 0x2000;
+  static const uint16 HEATER       = 0x8000;
+
+  static const uint16 TYPE = 0x0100 | POWER | FILTER | HEATER | BUBBLE | TEMP_UP | TEMP_DOWN | TEMP_UNIT | DISINFECTION | JET;
+  static const unsigned int FRAMES = 9; // number of button frames in each cycle
+};
+
+// model detection: button frames are only counted, not decoded
+template<> struct FRAME_BUTTON<PureSpaIO::MODEL::UNKNOWN>
+{
+  static const uint16 DISINFECTION = 0;
+  static const uint16 BUBBLE       = 0;
+  static const uint16 JET          = 0;
+  static const uint16 FILTER       = 0;
+  static const uint16 TEMP_DOWN    = 0;
+  static const uint16 POWER        = 0;
+  static const uint16 TEMP_UP      = 0;
+  static const uint16 TEMP_UNIT    = 0;
+  static const uint16 HEATER       = 0;
+
+  static const uint16 TYPE = FRAME_BUTTON<PureSpaIO::MODEL::SBH20>::TYPE | FRAME_BUTTON<PureSpaIO::MODEL::SJBHS>::TYPE;
+};
 
-#define DEFAULT_MODEL_NAME "Intex PureSpa SJB-HS"
+// LED status decoding is model independent
+static_assert(FRAME_LED<PureSpaIO::MODEL::SBH20>::NO_BEEP == FRAME_LED<PureSpaIO::MODEL::SJBHS>::NO_BEEP, "NO_BEEP mask must not depend on model");
 
-// bit mask for LEDs
-namespace FRAME_LED
+namespace MODEL_NAME
 {
-  const uint16 POWER          = 0x0001;
-  const uint16 BUBBLE         = 0x0002;  // max. 30 min
-  const uint16 HEATER_ON      = 0x0080;  // max. 72 h, will start filter, will not stop filter
-  const uint16 NO_BEEP        = 0x0100;
-  const uint16 HEATER_STANDBY = 0x0200;
-  const uint16 JET            = 0x0400;
-  const uint16 FILTER         = 0x1000;  // max. 24 h
-  const uint16 DISINFECTION   = 0x2000;  // max. 8 h
+#ifdef CUSTOM_MODEL_NAME
+  const char UNKNOWN[] = CUSTOM_MODEL_NAME;
+  const char SBH20[]   = CUSTOM_MODEL_NAME;
+  const char SJBHS[]   = CUSTOM_MODEL_NAME;
+#else
+  const char UNKNOWN[] = "Intex PureSpa";
+  const char SBH20[]   = "Intex PureSpa SB-H20";
+  const char SJBHS[]   = "Intex PureSpa SJB-HS";
+#endif
 }
 
-// bit mask of button
-namespace FRAME_BUTTON
+namespace BUS_HEALTH_NAME
 {
-  const uint16 DISINFECTION = 0x0001;
-  const uint16 BUBBLE       = 0x0002;
-  const uint16 JET          = 0x0008;
-  const uint16 FILTER       = 0x0080;
-  const uint16 TEMP_DOWN    = 0x0200;
-  const uint16 POWER        = 0x0400;
-  const uint16 TEMP_UP      = 0x1000;
-  const uint16 TEMP_UNIT    = 0x2000;
-  const uint16 HEATER       = 0x8000;
+  const char UNKNOWN[]    PROGMEM = "unknown";
+  const char OK[]         PROGMEM = "ok";
+  const char NO_CLOCK[]   PROGMEM = "no clock";
+  const char LATCH_HIGH[] PROGMEM = "latch stuck high";
+  const char LATCH_LOW[]  PROGMEM = "latch stuck low";
+  const char FRAMING[]    PROGMEM = "framing errors";
+  const char DECODING[]   PROGMEM = "decoding errors";
+
+  const char* const NAMES[] PROGMEM = { UNKNOWN, OK, NO_CLOCK, LATCH_HIGH, LATCH_LOW, FRAMING, DECODING };
 }
 
-#endif
+namespace SCENE_NAME
+{
+  const char* const SETTINGS[PureSpaIO::Scene::SETTINGS] = { "power", "heater", "filter", "bubble", "jet", "disinfection", "water" };
+}
 
-#ifdef CUSTOM_MODEL_NAME
-const char MODEL_NAME[] = CUSTOM_MODEL_NAME;
-#else
-const char MODEL_NAME[] = DEFAULT_MODEL_NAME;
-#endif  
+namespace OUTCOME_NAME
+{
+  const char* const OUTCOMES[] = { "planned", "confirmed", "unconfirmed", "failed", "conflict", "unsupported" };
+}
 
 namespace FRAME_DIGIT
 {
@@ -137,18 +193,12 @@ namespace FRAME_DIGIT
   const uint16 LET_N = SEGMENT_A | SEGMENT_B | SEGMENT_C | SEGMENT_E | SEGMENT_F;
 }
 
-// frame type markers
+// frame type markers, button frames see FRAME_BUTTON
 namespace FRAME_TYPE
 {
   const uint16 CUE    = 0x0100;
   const uint16 LED    = 0x4000;
   const uint16 DIGIT  = FRAME_DIGIT::POS_1 | FRAME_DIGIT::POS_2 | FRAME_DIGIT::POS_3 | FRAME_DIGIT::POS_4;
-
-#if defined MODEL_SB_H20
-  const uint16 BUTTON = CUE | FRAME_BUTTON::POWER | FRAME_BUTTON::FILTER | FRAME_BUTTON::HEATER | FRAME_BUTTON::BUBBLE | FRAME_BUTTON::TEMP_UP | FRAME_BUTTON::TEMP_DOWN | FRAME_BUTTON::TEMP_UNIT;
-#elif defined MODEL_SJB_HS
-  const uint16 BUTTON = CUE | FRAME_BUTTON::POWER | FRAME_BUTTON::FILTER | FRAME_BUTTON::HEATER | FRAME_BUTTON::BUBBLE | FRAME_BUTTON::TEMP_UP | FRAME_BUTTON::TEMP_DOWN | FRAME_BUTTON::TEMP_UNIT | FRAME_BUTTON::DISINFECTION | FRAME_BUTTON::JET;
-#endif
 }
 
 namespace DIGIT
@@ -211,6 +261,29 @@ namespace ERROR
                                                  { EN_90,   EN_91,   EN_92,   EN_94,   EN_95,   EN_96,   EN_97,   EN_99,   EN_END,   EN_OTHER },
                                                  { DE_90,   DE_91,   DE_92,   DE_94,   DE_95,   DE_96,   DE_97,   DE_99,   DE_END,   DE_OTHER }
                                                };
+
+  // packed error code as decoded from display (ASCII, little endian)
+  constexpr uint32 pack(const char (&code)[4])
+  {
+    return (uint32)code[0] | ((uint32)code[1] << 8) | ((uint32)code[2] << 16);
+  }
+
+  constexpr uint32 PACKED[COUNT] = { pack("E90"), pack("E91"), pack("E92"), pack("E94"), pack("E95"), pack("E96"), pack("E97"), pack("E99"), pack("END") };
+
+  // @return column of TEXT or COUNT if undefined
+  constexpr unsigned int index(uint32 code)
+  {
+    for (unsigned int i=0; i<COUNT; i++)
+    {
+      if (PACKED[i] == code)
+      {
+        return i;
+      }
+    }
+    return COUNT;
+  }
+
+  static_assert(index(pack("E90")) == 0 && index(pack("END")) == COUNT - 1 && index(pack("E93")) == COUNT, "error code mapping");
 }
 
 // special display values
@@ -225,62 +298,752 @@ inline bool displayIsBlank(uint32 v)    { return (v & 0x00FFFFFFU) == (' ' << 16
 volatile PureSpaIO::State PureSpaIO::state;
 volatile PureSpaIO::IsrState PureSpaIO::isrState;
 volatile PureSpaIO::Buttons PureSpaIO::buttons;
+volatile PureSpaIO::Capture PureSpaIO::capture;
+volatile PureSpaIO::CommandTiming PureSpaIO::commandTiming;
+#ifdef ISR_PROFILING
+volatile PureSpaIO::Profile PureSpaIO::isrProfile;
+#endif
+
+namespace POOL_METRIC
+{
+  const char FRAMES[]          PROGMEM = "pool_frames_total";
+  const char FRAMES_DROPPED[]  PROGMEM = "pool_frames_dropped_total";
+  const char BUTTON_FAILURES[] PROGMEM = "pool_button_failures_total";
+  const char BUTTON_RETRIES[]  PROGMEM = "pool_button_retries_total";
+  const char BUTTON_REPEATS[]  PROGMEM = "pool_button_repeats_total";
+  const char BUTTON_DURATION[] PROGMEM = "pool_button_ms";
+  const char GROUP_ERRORS[]    PROGMEM = "pool_display_group_errors_total";
+  const char VOTE_FAILURES[]   PROGMEM = "pool_display_vote_failures_total";
+  const char INVALID_DIGITS[]  PROGMEM = "pool_display_invalid_digits_total";
+  const char UNSUPPORTED[]     PROGMEM = "pool_frames_unsupported_total";
+  const char ERROR_RATE[]      PROGMEM = "pool_bus_error_ppm";
+  const char CONFIRM_CYCLES[]  PROGMEM = "pool_display_confirm_cycles";
+  const char CONFIRM_FRAMES[]  PROGMEM = "pool_led_confirm_frames";
+  const char CYCLE_PERIOD[]    PROGMEM = "pool_cycle_period_us";
+  const char BUS_HEALTH[]      PROGMEM = "pool_bus_health";
+  const char BUS_LOSSES[]      PROGMEM = "pool_bus_losses_total";
+  const char CAPTURE_FAILED[]  PROGMEM = "pool_capture_failures_total";
+  const char DETECTION_FAILED[] PROGMEM = "pool_model_detection_failures_total";
+
+  const uint32 BUTTON_DURATION_BOUNDS[] = { 250, 500, 750, 1000, 1500, 2000 }; // [ms]
+}
+
+Metrics::Counter PureSpaIO::framesTotal(POOL_METRIC::FRAMES);
+Metrics::Counter PureSpaIO::framesDropped(POOL_METRIC::FRAMES_DROPPED);
+Metrics::Counter PureSpaIO::buttonFailures(POOL_METRIC::BUTTON_FAILURES);
+Metrics::Counter PureSpaIO::buttonRetries(POOL_METRIC::BUTTON_RETRIES);
+Metrics::Counter PureSpaIO::buttonRepeats(POOL_METRIC::BUTTON_REPEATS);
+Metrics::FixedHistogram<6> PureSpaIO::buttonDuration(POOL_METRIC::BUTTON_DURATION, POOL_METRIC::BUTTON_DURATION_BOUNDS);
+Metrics::Counter PureSpaIO::displayGroupErrors(POOL_METRIC::GROUP_ERRORS);
+Metrics::Counter PureSpaIO::displayVoteFailures(POOL_METRIC::VOTE_FAILURES);
+Metrics::Counter PureSpaIO::invalidDigits(POOL_METRIC::INVALID_DIGITS);
+Metrics::Counter PureSpaIO::unsupportedFrames(POOL_METRIC::UNSUPPORTED);
+Metrics::Gauge PureSpaIO::busErrorRate(POOL_METRIC::ERROR_RATE);
+Metrics::Gauge PureSpaIO::displayConfirmCycles(POOL_METRIC::CONFIRM_CYCLES);
+Metrics::Gauge PureSpaIO::ledConfirmFrames(POOL_METRIC::CONFIRM_FRAMES);
+Metrics::Gauge PureSpaIO::cyclePeriodGauge(POOL_METRIC::CYCLE_PERIOD);
+Metrics::Gauge PureSpaIO::busHealthGauge(POOL_METRIC::BUS_HEALTH);
+Metrics::Counter PureSpaIO::busLosses(POOL_METRIC::BUS_LOSSES);
+Metrics::Counter PureSpaIO::captureFailures(POOL_METRIC::CAPTURE_FAILED);
+Metrics::Counter PureSpaIO::detectionFailures(POOL_METRIC::DETECTION_FAILED);
+
+
+// @TODO detect act temp change during error
+// @TODO improve reliability of water temp change (counter auto repeat and too short press)
+/**
+ * attach clock ISR to start decoding
+ *
+ * note: should be called as early as possible after power up to catch
+ *       the initial blinking of the desired water temperature
+ */
+void PureSpaIO::setup(LANG language, RadioPolicy& radioPolicy)
+{
+  this->language = language;
+  this->radioPolicy = &radioPolicy;
+
+  restoreState();
+
+  pinMode(PIN::CLOCK, INPUT);
+  pinMode(PIN::DATA,  INPUT);
+  pinMode(PIN::LATCH, INPUT);
+  GPOC = bit(PIN::DATA); // output value for reply pulse
+
+  // reply pulse is timed by timer1, the clock ISR only arms it
+  timer1_attachInterrupt(PureSpaIO::replyTimerISR);
+  timer1_enable(TIM_DIV1, TIM_EDGE, TIM_SINGLE);
+
+  attachDecoder();
+
+  // wait for model detection to have the model available for MQTT setup
+  if (model == MODEL::UNKNOWN)
+  {
+    esp_delay(MODEL_DETECTION::TIMEOUT, []() -> bool { return state.detectedModel == MODEL::UNKNOWN; });
+    if (state.detectedModel != MODEL::UNKNOWN)
+    {
+      model = state.detectedModel;
+      attachDecoder();
+    }
+  }
+}
+
+/**
+ * attach the clock ISR specialised for the model, or the ISR for model
+ * detection if the model is not known yet
+ */
+void PureSpaIO::attachDecoder()
+{
+#if defined MODEL_SB_H20
+  attachInterruptArg(digitalPinToInterrupt(PIN::CLOCK), PureSpaIO::clockRisingISR<MODEL::SBH20>, this, RISING);
+#elif defined MODEL_SJB_HS
+  attachInterruptArg(digitalPinToInterrupt(PIN::CLOCK), PureSpaIO::clockRisingISR<MODEL::SJBHS>, this, RISING);
+#else
+  switch (model)
+  {
+    case MODEL::SBH20:
+      attachInterruptArg(digitalPinToInterrupt(PIN::CLOCK), PureSpaIO::clockRisingISR<MODEL::SBH20>, this, RISING);
+      break;
+
+    case MODEL::SJBHS:
+      attachInterruptArg(digitalPinToInterrupt(PIN::CLOCK), PureSpaIO::clockRisingISR<MODEL::SJBHS>, this, RISING);
+      break;
+
+    default:
+      attachInterruptArg(digitalPinToInterrupt(PIN::CLOCK), PureSpaIO::clockRisingISR<MODEL::UNKNOWN>, this, RISING);
+      break;
+  }
+#endif
+}
+
+PureSpaIO::MODEL PureSpaIO::getModel() const
+{
+  return model;
+}
+
+const char* PureSpaIO::getModelName() const
+{
+  switch (model)
+  {
+    case MODEL::SBH20:
+      return MODEL_NAME::SBH20;
+
+    case MODEL::SJBHS:
+      return MODEL_NAME::SJBHS;
+
+    default:
+      return MODEL_NAME::UNKNOWN;
+  }
+}
+
+void PureSpaIO::loop()
+{
+  // device online check
+  unsigned long now = millis();
+  if (state.stateUpdated)
+  {
+    lastStateUpdateTime = now;
+    state.online = true;
+    state.stateUpdated = false;
+  }
+  else if (timeDiff(now, lastStateUpdateTime) > CYCLE::RECEIVE_TIMEOUT)
+  {
+    state.online = false;
+  }
+
+  // switch to decoder of detected model
+  if (model == MODEL::UNKNOWN && state.detectedModel != MODEL::UNKNOWN)
+  {
+    model = state.detectedModel;
+    attachDecoder();
+  }
+
+  // restored state is confirmed when the desired temp has been read from the display
+  if (stale && state.desiredTempConfirmed)
+  {
+    stale = false;
+  }
+
+  saveState();
+
+  // freeze capture ring on decoding errors
+  unsigned int captureErrorCount = state.invalidDigits + state.unsupportedFrames + state.frameDropped + state.displayVoteFailures;
+  if (captureErrorCount != lastCaptureErrorCount)
+  {
+    lastCaptureErrorCount = captureErrorCount;
+    triggerCapture();
+  }
+
+  adaptConfirmation(now);
+  calibrateCycle(now);
+
+  framesTotal.set(state.frameCounter);
+  framesDropped.set(state.frameDropped);
+  displayGroupErrors.set(state.displayGroupErrors);
+  displayVoteFailures.set(state.displayVoteFailures);
+  invalidDigits.set(state.invalidDigits);
+  unsupportedFrames.set(state.unsupportedFrames);
+  detectionFailures.set(state.detectionFailures);
+}
+
+/**
+ * classify bus signals of the last check period, detects a lost bus within
+ * 2 frame cycles instead of the receive timeout
+ *
+ * notes:
+ * - the latch is inactive at least for the last bit of each frame
+ * - the device is offline immediately if the bus is lost
+ */
+void PureSpaIO::checkBusHealth()
+{
+  BusCounters counters;
+  counters.clockEdges     = state.clockEdges;
+  counters.latchEdges     = state.latchEdges;
+  counters.completeFrames = state.completeFrames;
+  counters.decodeErrors   = state.invalidDigits + state.unsupportedFrames + state.displayVoteFailures;
+
+  unsigned long edges  = diff(counters.clockEdges, lastBusCounters.clockEdges);
+  unsigned long latch  = diff(counters.latchEdges, lastBusCounters.latchEdges);
+  unsigned long frames = diff(counters.completeFrames, lastBusCounters.completeFrames);
+  unsigned long errors = diff(counters.decodeErrors, lastBusCounters.decodeErrors);
+  lastBusCounters = counters;
+
+  BUS_HEALTH health;
+  if (!edges)
+  {
+    health = BUS_NO_CLOCK;
+  }
+  else if (!latch)
+  {
+    health = BUS_LATCH_HIGH;
+  }
+  else if (latch == edges)
+  {
+    health = BUS_LATCH_LOW;
+  }
+  else if (!frames)
+  {
+    health = BUS_FRAMING;
+  }
+  else if (2*errors > frames)
+  {
+    health = BUS_DECODING;
+  }
+  else
+  {
+    health = BUS_OK;
+  }
+
+  bool lost = health != BUS_OK && health != BUS_DECODING;
+  if (health != busHealth)
+  {
+    if (lost && (busHealth == BUS_OK || busHealth == BUS_DECODING))
+    {
+      busLosses.inc();
+      triggerCapture();
+    }
+    if (health == BUS_NO_CLOCK)
+    {
+      busSilentTime = millis();
+    }
+    busHealth = health;
+    busHealthGauge.set(health);
+    state.stateChanged = true;
+  }
+
+  if (lost)
+  {
+    state.online = false;
+  }
+}
+
+/**
+ * @return [ppm] smoothed error rate of received frames
+ */
+unsigned int PureSpaIO::getErrorRate() const
+{
+  return errorRate;
+}
+
+PureSpaIO::BUS_HEALTH PureSpaIO::getBusHealth() const
+{
+  return busHealth;
+}
+
+/**
+ * @param duration ms
+ * @return true if no clock edge was detected for at least the duration
+ */
+bool PureSpaIO::isBusSilent(unsigned long duration) const
+{
+  return busHealth == BUS_NO_CLOCK && timeDiff(millis(), busSilentTime) >= duration;
+}
+
+/**
+ * enable or disable wake up on bus activity for low power idle mode
+ *
+ * notes:
+ * - the latch pin is used as GPIO wake source from light sleep because
+ *   the interrupt of the clock pin is used by the decoder
+ * - the light sleep wake source only supports level triggering, it is
+ *   disarmed on the first wake up because it would retrigger constantly
+ *   while the latch toggles
+ * - the first clock edge or a change of the latch level ends the sleep
+ *   of the main loop
+ * - the bus silence duration restarts when idle mode ends
+ *
+ * @param idle
+ */
+void PureSpaIO::setIdle(bool idle)
+{
+  this->idle = idle;
+  if (idle)
+  {
+    idleLatchLevel = digitalRead(PIN::LATCH);
+    wifi_enable_gpio_wakeup(GPIO_ID_PIN(PIN::LATCH), idleLatchLevel? GPIO_PIN_INTR_LOLEVEL : GPIO_PIN_INTR_HILEVEL);
+    wakeupArmed = true;
+    state.wakeOnClock = true;
+  }
+  else
+  {
+    state.wakeOnClock = false;
+    if (wakeupArmed)
+    {
+      wifi_disable_gpio_wakeup();
+      wakeupArmed = false;
+    }
+    busSilentTime = millis();
+  }
+}
+
+/**
+ * check for wake up in idle mode, disarms the GPIO wake source on the
+ * first wake up
+ *
+ * @return true if a clock edge or a change of the latch level was detected in idle mode
+ */
+bool PureSpaIO::isWakeupPending()
+{
+  if (idle && wakeupArmed && (!state.wakeOnClock || digitalRead(PIN::LATCH) != idleLatchLevel))
+  {
+    wifi_disable_gpio_wakeup();
+    wakeupArmed = false;
+  }
+  return idle && !wakeupArmed;
+}
+
+/**
+ * @return PROGMEM name of bus health
+ */
+const char* PureSpaIO::getBusHealthName() const
+{
+  return BUS_HEALTH_NAME::NAMES[busHealth];
+}
+
+/**
+ * adapt confirmation thresholds of display and LED status to bus error rate:
+ * low latency on a clean bus, more filtering on a noisy bus
+ */
+void PureSpaIO::adaptConfirmation(unsigned long now)
+{
+  if (timeDiff(now, lastErrorRateTime) < ERROR_RATE::PERIOD)
+  {
+    return;
+  }
+  lastErrorRateTime = now;
+
+  // error rate of last period, smoothed
+  unsigned int errorCount = state.invalidDigits + state.unsupportedFrames + state.frameDropped + state.displayGroupErrors;
+  unsigned int frameCount = state.completeFrames + state.frameDropped; // decoded frames only, no clock edges
+  unsigned long errors = diff(errorCount, lastErrorCount);
+  unsigned long frames = diff(frameCount, lastFrameCount);
+  lastErrorCount = errorCount;
+  lastFrameCount = frameCount;
+  if (frames == 0)
+  {
+    // offline, keep thresholds
+    return;
+  }
+  unsigned long rate = errors < frames? (uint64_t)errors*1000000/frames : 1000000;
+  errorRate = (3*errorRate + rate)/4;
+
+  // select thresholds, rising error rate takes effect immediately
+  unsigned int level;
+  if (errorRate < ERROR_RATE::CLEAN && rate < ERROR_RATE::NOISY)
+  {
+    level = 0;
+  }
+  else if (errorRate < ERROR_RATE::NOISY && rate < ERROR_RATE::NOISY)
+  {
+    level = 1;
+  }
+  else
+  {
+    level = 2;
+  }
+  state.confirmCycles = CONFIRM_CYCLES::MIN + level*(CONFIRM_CYCLES::MAX - CONFIRM_CYCLES::MIN)/2;
+  state.confirmFrames = CONFIRM_FRAMES::MIN + level*(CONFIRM_FRAMES::MAX - CONFIRM_FRAMES::MIN)/2;
+
+  busErrorRate.set(errorRate);
+  displayConfirmCycles.set(state.confirmCycles);
+  ledConfirmFrames.set(state.confirmFrames);
+}
+
+/**
+ * calibrate the period of the frame cycle and derive the cycle based
+ * thresholds from it
+ */
+void PureSpaIO::calibrateCycle(unsigned long now)
+{
+  unsigned long elapsed = timeDiff(now, lastCalibrationTime);
+  if (elapsed < CYCLE::CALIBRATION_PERIOD)
+  {
+    return;
+  }
+  lastCalibrationTime = now;
+
+  unsigned int cycleCount = state.cycleCounter;
+  unsigned long cycles = diff(cycleCount, lastCycleCount);
+  lastCycleCount = cycleCount;
+  if (cycles == 0)
+  {
+    // offline, keep period
+    return;
+  }
+
+  unsigned long period = 1000*elapsed/cycles;
+  if (period < CYCLE::PERIOD_MIN || period > CYCLE::PERIOD_MAX)
+  {
+    // implausible, e.g. cycles lost
+    return;
+  }
+  cyclePeriod = (3*cyclePeriod + period)/4;
+  state.notBlinkingCycles = 1000*BLINK::PERIOD/2/cyclePeriod;
+
+  cyclePeriodGauge.set(cyclePeriod);
+}
+
+uint32 PureSpaIO::persistentStateChecksum() const
+{
+  return crc32((const uint8*)&persistentState + sizeof(persistentState.crc), sizeof(persistentState) - sizeof(persistentState.crc));
+}
+
+/**
+ * restore last confirmed state from RTC memory (survives reset and OTA update but not power cycle)
+ *
+ * note: restored state is stale until confirmed by the display
+ */
+void PureSpaIO::restoreState()
+{
+  if (ESP.rtcUserMemoryRead(RTC_BLOCK::SPA_STATE, (uint32*)&persistentState, sizeof(persistentState))
+      && persistentState.crc == persistentStateChecksum())
+  {
+    state.waterTemp        = persistentState.waterTemp;
+    state.desiredTemp      = persistentState.desiredTemp;
+    state.disinfectionTime = persistentState.disinfectionTime;
+    state.error            = persistentState.error;
+    state.ledStatus        = persistentState.ledStatus;
+    if (model == MODEL::UNKNOWN && (persistentState.model == MODEL::SBH20 || persistentState.model == MODEL::SJBHS))
+    {
+      model = (MODEL)persistentState.model;
+    }
+    stale = true;
+    DEBUG_MSG("\nstate restored (frame %u)", persistentState.frameCounter);
+  }
+  else
+  {
+    persistentState = PersistentState();
+  }
+}
+
+/**
+ * @return desired water temperature [°C] or UNDEF::INT if unknown or only restored
+ *         and not yet confirmed by the display
+ *
+ * note: evaluates the ISR flag directly because the main loop is blocked
+ *       while a command waits for the readback
+ */
+int PureSpaIO::getConfirmedDesiredWaterTempCelsius() const
+{
+  return (stale && !state.desiredTempConfirmed)? UNDEF::INT : getDesiredWaterTempCelsius();
+}
+
+/**
+ * write state to RTC memory if changed
+ */
+void PureSpaIO::saveState()
+{
+  if (persistentState.waterTemp != state.waterTemp
+      || persistentState.desiredTemp != state.desiredTemp
+      || persistentState.disinfectionTime != state.disinfectionTime
+      || persistentState.error != state.error
+      || persistentState.ledStatus != state.ledStatus
+      || persistentState.model != model)
+  {
+    persistentState.waterTemp        = state.waterTemp;
+    persistentState.desiredTemp      = state.desiredTemp;
+    persistentState.disinfectionTime = state.disinfectionTime;
+    persistentState.error            = state.error;
+    persistentState.ledStatus        = state.ledStatus;
+    persistentState.model            = model;
+    persistentState.frameCounter     = state.frameCounter;
+    persistentState.crc              = persistentStateChecksum();
+    ESP.rtcUserMemoryWrite(RTC_BLOCK::SPA_STATE, (uint32*)&persistentState, sizeof(persistentState));
+  }
+}
+
+bool PureSpaIO::isOnline() const
+{
+  return state.online;
+}
+
+/**
+ * @return true if LEDs, actual and desired water temperature are known and
+ *         not only restored after a reset
+ */
+bool PureSpaIO::isStateComplete() const
+{
+  return !stale && state.ledStatus != UNDEF::USHORT && state.waterTemp != UNDEF::UINT && state.desiredTemp != UNDEF::UINT;
+}
+
+/**
+ * @return true if the state was restored after a reset and has not been confirmed yet
+ */
+bool PureSpaIO::isStateStale() const
+{
+  return stale;
+}
 
+/**
+ * @return true if the decoded pool state has changed since last call of clearStateChanged()
+ */
+bool PureSpaIO::isStateChanged() const
+{
+  return state.stateChanged;
+}
+
+/**
+ * read and clear the state change flag atomically, a change signalled by
+ * the ISR is never lost
+ *
+ * @return true if the decoded pool state has changed since last call
+ */
+bool PureSpaIO::clearStateChanged()
+{
+  noInterrupts();
+  bool changed = state.stateChanged;
+  state.stateChanged = false;
+  interrupts();
+
+  return changed;
+}
+
+unsigned int PureSpaIO::getTotalFrames() const
+{
+  return state.frameCounter;
+}
+
+unsigned int PureSpaIO::getDroppedFrames() const
+{
+  return state.frameDropped;
+}
+
+/**
+ * start recording the times of the command stages, see CommandTiming
+ *
+ * @param start [µs] start time of command
+ */
+void PureSpaIO::startCommandTiming(uint32 start)
+{
+  noInterrupts();
+  commandTiming.reply   = 0;
+  commandTiming.ack     = 0;
+  commandTiming.confirm = 0;
+  commandTiming.start   = start? start : 1;
+  interrupts();
+}
+
+/**
+ * @param timing times of command stages [µs] since last start, 0 = not reached
+ */
+void PureSpaIO::getCommandTiming(CommandTiming& timing) const
+{
+  noInterrupts();
+  timing.start   = commandTiming.start;
+  timing.reply   = commandTiming.reply;
+  timing.ack     = commandTiming.ack;
+  timing.confirm = commandTiming.confirm;
+  interrupts();
+}
+
+void PureSpaIO::stopCommandTiming()
+{
+  commandTiming.start = 0;
+}
+
+/**
+ * reset result of next command, outcome and counters are updated by the setters
+ */
+void PureSpaIO::startCommandResult()
+{
+  commandResult = CommandResult();
+  commandResultTime = millis();
+  commandResultPresses = buttonPresses;
+}
 
-// @TODO detect when latch signal stays low
-// @TODO detect act temp change during error
-// @TODO improve reliability of water temp change (counter auto repeat and too short press)
-void PureSpaIO::setup(LANG language)
+/**
+ * @param result outcome and counters of last command
+ */
+void PureSpaIO::getCommandResult(CommandResult& result) const
 {
-  this->language = language;
+  result = commandResult;
+  result.presses = diff(buttonPresses, commandResultPresses);
+  result.duration = timeDiff(millis(), commandResultTime);
+}
 
-  pinMode(PIN::CLOCK, INPUT);
-  pinMode(PIN::DATA,  INPUT);
-  pinMode(PIN::LATCH, INPUT);
+void PureSpaIO::countRetry()
+{
+  commandResult.retries++;
+  buttonRetries.inc();
+}
 
-  attachInterruptArg(digitalPinToInterrupt(PIN::CLOCK), PureSpaIO::clockRisingISR, this, RISING);
+void PureSpaIO::countRepeat()
+{
+  commandResult.repeats++;
+  buttonRepeats.inc();
 }
 
-PureSpaIO::MODEL PureSpaIO::getModel() const
+const char* PureSpaIO::getOutcomeName(uint8 outcome)
 {
-  return model;
+  return OUTCOME_NAME::OUTCOMES[outcome];
 }
 
-const char* PureSpaIO::getModelName() const
+/**
+ * @param setting Scene::SETTING
+ * @return JSON key of scene setting
+ */
+const char* PureSpaIO::getSceneSettingName(unsigned int setting)
 {
-  return MODEL_NAME;
+  return SCENE_NAME::SETTINGS[setting];
 }
 
-void PureSpaIO::loop()
+/**
+ * start recording of raw frames (except cue frames) into a ring in RAM
+ *
+ * notes:
+ * - single shot: the next frames are recorded until the ring is full
+ * - ring: frames are recorded continuously until triggered by a decoding
+ *   error, a bus loss or triggerCapture(), then the ring is frozen after
+ *   1/CAPTURE::POST_TRIGGER of its size to keep the frames before and after
+ *   the trigger
+ *
+ * @param frames size of ring, max. CAPTURE::MAX_FRAMES
+ * @param ring true to record until triggered, false for single shot
+ * @return true if recording was started, false if out of memory
+ */
+bool PureSpaIO::startCapture(unsigned int frames, bool ring)
 {
-  // device online check
-  unsigned long now = millis();
-  if (state.stateUpdated)
+  stopCapture();
+
+  if (frames > CAPTURE::MAX_FRAMES)
   {
-    lastStateUpdateTime = now;
-    state.online = true;
-    state.stateUpdated = false;
+    frames = CAPTURE::MAX_FRAMES;
   }
-  else if (timeDiff(now, lastStateUpdateTime) > CYCLE::RECEIVE_TIMEOUT)
+  uint32* buffer = (uint32*)malloc(frames*sizeof(uint32));
+  if (buffer)
   {
-    state.online = false;
+    capture.count = 0;
+    capture.head = 0;
+    capture.size = frames;
+    capture.remaining = ring? 0 : frames;
+    capture.frozen = false;
+    capture.lastTime = micros();
+    capture.buffer = buffer;
   }
+  else
+  {
+    captureFailed = true;
+    captureFailures.inc();
+  }
+
+  return buffer != nullptr;
 }
 
-bool PureSpaIO::isOnline() const
+/**
+ * freeze capture ring after the post trigger frames, ignored if no ring is
+ * recording or if already triggered
+ */
+void PureSpaIO::triggerCapture()
 {
-  return state.online;
+  if (capture.buffer && !capture.remaining)
+  {
+    unsigned int post = capture.size/CAPTURE::POST_TRIGGER;
+    capture.remaining = post? post : 1;
+  }
 }
 
-unsigned int PureSpaIO::getTotalFrames() const
+/**
+ * stop recording and release capture buffer
+ */
+void PureSpaIO::stopCapture()
 {
-  return state.frameCounter;
+  uint32* buffer = capture.buffer;
+  capture.buffer = nullptr;
+  free(buffer);
+  captureFailed = false;
 }
 
-unsigned int PureSpaIO::getDroppedFrames() const
+bool PureSpaIO::isCaptureComplete() const
 {
-  return state.frameDropped;
+  return capture.buffer && capture.frozen;
+}
+
+/**
+ * @return true if the capture buffer could not be allocated, reset by stopCapture()
+ */
+bool PureSpaIO::isCaptureFailed() const
+{
+  return captureFailed;
+}
+
+/**
+ * @param frames number of recorded frames
+ * @param first ring index of oldest frame
+ * @param size ring size
+ * @return ring with recorded frames or nullptr if no capture is available
+ */
+const uint32* PureSpaIO::getCapture(unsigned int& frames, unsigned int& first, unsigned int& size) const
+{
+  frames = capture.count;
+  size = capture.size;
+  first = capture.count < capture.size? 0 : capture.head;
+  return capture.buffer;
+}
+
+#ifdef ISR_PROFILING
+/**
+ * get ISR statistics since last call and reset statistics
+ *
+ * note: the cycles do not include the interrupt entry and exit of the core
+ *
+ * @param profile
+ */
+void PureSpaIO::getProfile(Profile& profile)
+{
+  noInterrupts();
+  for (unsigned int i=0; i<PROFILE::PROFILE_TYPES; i++)
+  {
+    volatile ProfileStats& stats = isrProfile.stats[i];
+    profile.stats[i].count = stats.count;
+    profile.stats[i].max   = stats.max;
+    profile.stats[i].sum   = stats.sum;
+    stats.count = 0;
+    stats.max   = 0;
+    stats.sum   = 0;
+  }
+  profile.overBudget = isrProfile.overBudget;
+  isrProfile.overBudget = 0;
+  interrupts();
 }
+#endif
 
 /**
  * @return actual water temperatur [°C] 0..60 or UNDEF::INT if unknown
@@ -293,7 +1056,8 @@ int PureSpaIO::getActWaterTempCelsius() const
 /**
  * @return desired water temperatur [°C] or UNDEF::INT if unknown
  *
- * note: value is undefined after power up until value is changed
+ * note: value is undefined after power up until value is changed,
+ *       after a reset the last known value is restored (see isStateStale())
  */
 int PureSpaIO::getDesiredWaterTempCelsius() const
 {
@@ -310,44 +1074,22 @@ int PureSpaIO::getDisinfectionTime() const
   return isDisinfectionOn() ? (state.disinfectionTime != UNDEF::UINT ? display2Num(state.disinfectionTime) : UNDEF::INT) : 0;
 }
 
-String PureSpaIO::getErrorCode() const
+/**
+ * @return error code as 3 ASCII chars packed little endian or ERROR_NONE
+ */
+uint32 PureSpaIO::getErrorCode() const
 {
-  memcpy((void*)errorBuffer, (void*)&state.error, 4);
-  return errorBuffer;
+  return state.error;
 }
 
-String PureSpaIO::getErrorMessage(const String& errorCode) const
+/**
+ * @param errorCode packed error code
+ * @return PROGMEM error message in configured language or nullptr if no error or undefined error
+ */
+const char* PureSpaIO::getErrorMessage(uint32 errorCode) const
 {
-  if (errorCode.length())
-  {
-    // get error index
-    unsigned int errorIndex = UINT_MAX;
-    for (unsigned int i=0; i<ERROR::COUNT; i++)
-    {
-      String ec = FPSTR(ERROR::TEXT[(unsigned int)LANG::CODE][i]);
-      if (errorCode == ec)
-      {
-        errorIndex = i;
-        break;
-      }
-    }
-
-    // get error translation
-    if (errorIndex != UINT_MAX)
-    {
-      return FPSTR(ERROR::TEXT[(unsigned int)language][errorIndex]);
-    }
-    else
-    {
-      // undefined error
-      return errorCode;
-    }
-  }
-  else
-  {
-    // no error
-    return errorCode;
-  }
+  unsigned int errorIndex = ERROR::index(errorCode);
+  return (errorIndex < ERROR::COUNT)? ERROR::TEXT[(unsigned int)language][errorIndex] : nullptr;
 }
 
 unsigned int PureSpaIO::getRawLedValue() const
@@ -357,50 +1099,58 @@ unsigned int PureSpaIO::getRawLedValue() const
 
 uint8 PureSpaIO::isPowerOn() const
 {
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::POWER) != 0) : UNDEF::BOOL;
+  return isLedOn(FRAME_LED<MODEL::SBH20>::POWER, FRAME_LED<MODEL::SJBHS>::POWER);
 }
 
 uint8 PureSpaIO::isFilterOn() const
 {
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::FILTER) != 0) : UNDEF::BOOL;
+  return isLedOn(FRAME_LED<MODEL::SBH20>::FILTER, FRAME_LED<MODEL::SJBHS>::FILTER);
 }
 
 uint8 PureSpaIO::isBubbleOn() const
 {
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::BUBBLE) != 0) : UNDEF::BOOL;
+  return isLedOn(FRAME_LED<MODEL::SBH20>::BUBBLE, FRAME_LED<MODEL::SJBHS>::BUBBLE);
 }
 
 uint8 PureSpaIO::isHeaterOn() const
 {
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & (FRAME_LED::HEATER_ON | FRAME_LED::HEATER_STANDBY)) != 0) : UNDEF::BOOL;
+  return isLedOn(FRAME_LED<MODEL::SBH20>::HEATER_ON | FRAME_LED<MODEL::SBH20>::HEATER_STANDBY,
+                 FRAME_LED<MODEL::SJBHS>::HEATER_ON | FRAME_LED<MODEL::SJBHS>::HEATER_STANDBY);
 }
 
 uint8 PureSpaIO::isHeaterStandby() const
 {
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::HEATER_STANDBY) != 0) : UNDEF::BOOL;
+  return isLedOn(FRAME_LED<MODEL::SBH20>::HEATER_STANDBY, FRAME_LED<MODEL::SJBHS>::HEATER_STANDBY);
 }
 
 uint8 PureSpaIO::isBuzzerOn() const
 {
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::NO_BEEP) == 0) : UNDEF::BOOL;
+  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED<MODEL::SBH20>::NO_BEEP) == 0) : UNDEF::BOOL;
 }
 
 uint8 PureSpaIO::isDisinfectionOn() const
 {
-#ifdef MODEL_SJB_HS
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::DISINFECTION) != 0) : UNDEF::BOOL;
-#else
-  return false;
-#endif
+  return (model == MODEL::SJBHS) ? isLedOn(0, FRAME_LED<MODEL::SJBHS>::DISINFECTION) : false;
 }
 
 uint8 PureSpaIO::isJetOn() const
 {
-#ifdef MODEL_SJB_HS
-  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & FRAME_LED::JET) != 0) : UNDEF::BOOL;
-#else
-  return false;
-#endif
+  return (model == MODEL::SJBHS) ? isLedOn(0, FRAME_LED<MODEL::SJBHS>::JET) : false;
+}
+
+/**
+ * @param sbh20Mask LED mask of SB-H20
+ * @param sjbhsMask LED mask of SJB-HS
+ * @return LED state of current model or UNDEF::BOOL if model is not detected yet
+ */
+uint8 PureSpaIO::isLedOn(uint16 sbh20Mask, uint16 sjbhsMask) const
+{
+  if (model == MODEL::UNKNOWN)
+  {
+    return UNDEF::BOOL;
+  }
+  uint16 mask = (model == MODEL::SJBHS) ? sjbhsMask : sbh20Mask;
+  return (state.ledStatus != UNDEF::USHORT) ? ((state.ledStatus & mask) != 0) : UNDEF::BOOL;
 }
 
 /**
@@ -417,14 +1167,16 @@ uint8 PureSpaIO::isJetOn() const
  */
 void PureSpaIO::setDesiredWaterTempCelsius(int temp)
 {
+  commandResult.outcome = OUTCOME::UNSUPPORTED;
   if (temp >= WATER_TEMP::SET_MIN && temp <= WATER_TEMP::SET_MAX)
   {
+    commandResult.outcome = OUTCOME::FAILED;
     if (isPowerOn() && state.error == ERROR_NONE)
     {
 #ifdef FORCE_WIFI_SLEEP
       // try to get initial temp
       WiFi.forceSleepBegin();
-      int setTemp = getDesiredWaterTempCelsius();
+      int setTemp = getConfirmedDesiredWaterTempCelsius();
       //DEBUG_MSG("\nBset %d", setTemp);
       bool modifying = false;
       if (setTemp == UNDEF::INT)
@@ -439,7 +1191,7 @@ void PureSpaIO::setDesiredWaterTempCelsius(int temp)
         do
         {
           delay(sleep);
-          setTemp = getDesiredWaterTempCelsius();
+          setTemp = getConfirmedDesiredWaterTempCelsius();
           tries--;
         } while (setTemp == UNDEF::INT && tries);
 
@@ -485,11 +1237,22 @@ void PureSpaIO::setDesiredWaterTempCelsius(int temp)
 
       WiFi.forceSleepWake();
       delay(1);
+      commandResult.outcome = OUTCOME::UNCONFIRMED;
 #else
-      // trigger temp modification
-      if (!changeWaterTemp(-1))
+      // skip if confirmed setpoint already matches
+      int knownTemp = getConfirmedDesiredWaterTempCelsius();
+      if (knownTemp == temp)
+      {
+        commandResult.outcome = OUTCOME::CONFIRMED;
+        return;
+      }
+
+      // trigger temp modification, towards the new setpoint if the actual setpoint is known
+      int direction = (knownTemp != UNDEF::INT && temp > knownTemp)? +1 : -1;
+      if (!changeWaterTemp(direction))
       {
-        changeWaterTemp(+1);
+        countRetry();
+        changeWaterTemp(-direction);
       }
 
       int sleep = 5*CYCLE::PERIOD; // ms
@@ -510,7 +1273,7 @@ void PureSpaIO::setDesiredWaterTempCelsius(int temp)
         }
         while (getActualSetpoint)
         {
-          newSetTemp = getDesiredWaterTempCelsius();
+          newSetTemp = getConfirmedDesiredWaterTempCelsius();
           readTries--;
           getActualSetpoint = newSetTemp == setTemp && readTries;
           if (getActualSetpoint)
@@ -530,6 +1293,19 @@ void PureSpaIO::setDesiredWaterTempCelsius(int temp)
         }
         else
         {
+          if (setTemp != UNDEF::INT)
+          {
+            // more than 1 degree per press indicates auto repeat or double trigger
+            if (abs(newSetTemp - setTemp) > 1)
+            {
+              countRepeat();
+            }
+            else if (newSetTemp == setTemp && temp != setTemp)
+            {
+              countRetry();
+            }
+          }
+
           // update change tries based on inital delta
           if (setTemp == UNDEF::INT)
           {
@@ -552,11 +1328,24 @@ void PureSpaIO::setDesiredWaterTempCelsius(int temp)
         }
       } while (temp != setTemp && changeTries);
       DEBUG_MSG("\ncT:%d", changeTries);
+      commandResult.outcome = (temp == setTemp)? OUTCOME::CONFIRMED : OUTCOME::UNCONFIRMED;
 #endif
     }
   }
 }
 
+/**
+ * @param hours requested disinfection duration
+ * @return nearest available disinfection duration 0/3/5/8 h
+ */
+static int nearestDisinfectionTime(int hours)
+{
+  if (hours > 5)      return 8;
+  else if (hours > 3) return 5;
+  else if (hours > 0) return 3;
+  else                return 0;
+}
+
 /**
  * set desired disinfection duration by performing button actions
  * repeatedly until the requested duration is displayed
@@ -569,12 +1358,9 @@ void PureSpaIO::setDesiredWaterTempCelsius(int temp)
  */
 void PureSpaIO::setDisinfectionTime(int hours)
 {
-  // use nearest available value
-  if (hours > 5)      hours = 8;
-  else if (hours > 3) hours = 5;
-  else if (hours > 0) hours = 3;
-  else                hours = 0;
+  hours = nearestDisinfectionTime(hours);
 
+  commandResult.outcome = OUTCOME::FAILED;
   if (isPowerOn() && state.error == ERROR_NONE)
   {
 #ifdef FORCE_WIFI_SLEEP
@@ -590,17 +1376,23 @@ void PureSpaIO::setDisinfectionTime(int hours)
       {
         // error reading actual time, abort
         DEBUG_MSG("\naborted\n");
+        commandResult.outcome = OUTCOME::FAILED;
         break;
       }
       else if (actHours == hours)
       {
         // set and act time matches, done
+        commandResult.outcome = OUTCOME::CONFIRMED;
         break;
       }
 
       // toggle disinfection time
-      pressButton(buttons.toggleDisinfection);
+      if (!pressButton(buttons.toggleDisinfection))
+      {
+        countRetry();
+      }
       tries--;
+      commandResult.outcome = OUTCOME::UNCONFIRMED;
     } while (tries);
 
 #ifdef FORCE_WIFI_SLEEP
@@ -614,66 +1406,368 @@ void PureSpaIO::setDisinfectionTime(int hours)
  * press specific button and wait for confirmation (blocking)
  *
  * notes:
- * - WiFi is temporarily put to sleep to improve receive decoding reliability
+ * - WiFi sleep mode is selected by the radio policy to improve receive decoding reliability
  *
  * @param buttonPressCount
  * @return true if beep was received, false if no beep was received until timeout
  */
 bool PureSpaIO::pressButton(volatile unsigned int& buttonPressCount)
 {
+  unsigned long startTime = millis();
   waitBuzzerOff();
-  unsigned int tries = BUTTON::ACK_TIMEOUT/BUTTON::ACK_CHECK_PERIOD;
-  WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
+  setCommandActive(true);
   buttonPressCount = BUTTON::PRESS_COUNT;
-  while (buttonPressCount && tries)
+  buttonPresses++;
+  esp_delay(BUTTON::ACK_TIMEOUT, [&buttonPressCount]() -> bool { return buttonPressCount != 0; });
+  bool success = state.buzzer;
+  setCommandActive(false);
+
+  buttonDuration.observe(timeDiff(millis(), startTime));
+  if (!success)
+  {
+    buttonFailures.inc();
+  }
+
+  return success;
+}
+
+/**
+ * press toggle button if LED status differs and wait for LED confirmation (blocking)
+ *
+ * notes:
+ * - an auto repeat is only counted if the LED status changed twice or the
+ *   button was acknowledged twice, a late LED change is just unconfirmed
+ *
+ * @param on requested status
+ * @param isOn LED status getter
+ * @param button toggle button
+ */
+void PureSpaIO::setToggle(bool on, uint8 (PureSpaIO::*isOn)() const, volatile unsigned int& button)
+{
+  if (on ^ ((this->*isOn)() == true))
+  {
+    unsigned int acks = state.buzzerAcks;
+    unsigned int changes = state.ledChanges;
+    if (!pressButton(button))
+    {
+      commandResult.outcome = OUTCOME::FAILED;
+      return;
+    }
+    esp_delay(BUTTON::CONFIRM_TIMEOUT, [this, on, isOn]() -> bool { return on ^ ((this->*isOn)() == true); }, CYCLE::PERIOD);
+    if (on ^ ((this->*isOn)() == true))
+    {
+      if (state.ledChanges - changes >= 2 || state.buzzerAcks - acks >= 2)
+      {
+        // toggled twice
+        countRepeat();
+      }
+      commandResult.outcome = OUTCOME::UNCONFIRMED;
+      return;
+    }
+  }
+  commandResult.outcome = OUTCOME::CONFIRMED;
+}
+
+void PureSpaIO::setBubbleOn(bool on)
+{
+  setToggle(on, &PureSpaIO::isBubbleOn, buttons.toggleBubble);
+}
+
+void PureSpaIO::setFilterOn(bool on)
+{
+  setToggle(on, &PureSpaIO::isFilterOn, buttons.toggleFilter);
+}
+
+void PureSpaIO::setHeaterOn(bool on)
+{
+  setToggle(on, &PureSpaIO::isHeaterOn, buttons.toggleHeater);
+}
+
+void PureSpaIO::setJetOn(bool on)
+{
+  setToggle(on, &PureSpaIO::isJetOn, buttons.toggleJet);
+}
+
+void PureSpaIO::setPowerOn(bool on)
+{
+  setToggle(on, &PureSpaIO::isPowerOn, buttons.togglePower);
+}
+
+/**
+ * plan the minimal ordered button sequence to reach a scene from the
+ * current LED status
+ *
+ * notes:
+ * - power is pressed first if any other setting is requested while off,
+ *   the spa starts with all functions off
+ * - heater is planned before filter because turning on the heater
+ *   also turns on the filter
+ * - disinfection and water temperature come last because they need
+ *   repeated button presses with display readback
+ *
+ * @param scene requested settings
+ * @param steps planned steps with predicted number of presses
+ * @return number of steps
+ */
+unsigned int PureSpaIO::planScene(const Scene& scene, SceneResult::Step* steps) const
+{
+  // predict LED status after each step
+  uint8 predicted[Scene::DISINFECTION];
+  predicted[Scene::POWER]  = isPowerOn();
+  predicted[Scene::HEATER] = isHeaterOn();
+  predicted[Scene::FILTER] = isFilterOn();
+  predicted[Scene::BUBBLE] = isBubbleOn();
+  predicted[Scene::JET]    = isJetOn();
+  bool known = predicted[Scene::POWER] != UNDEF::BOOL && state.error == ERROR_NONE;
+
+  bool powerOff = scene.target[Scene::POWER] == 0;
+  bool othersRequested = false;
+  for (unsigned int setting=Scene::HEATER; setting<Scene::SETTINGS; setting++)
+  {
+    othersRequested |= scene.target[setting] != UNDEF::INT;
+  }
+
+  unsigned int count = 0;
+  for (unsigned int setting=Scene::POWER; setting<Scene::SETTINGS; setting++)
+  {
+    int target = scene.target[setting];
+    if (setting == Scene::POWER && target == UNDEF::INT && othersRequested)
+    {
+      // implicit power on
+      target = 1;
+    }
+    if (target == UNDEF::INT)
+    {
+      continue;
+    }
+
+    SceneResult::Step& step = steps[count++];
+    step = SceneResult::Step();
+    step.setting = setting;
+    step.target = target;
+
+    if (!known)
+    {
+      step.outcome = OUTCOME::FAILED;
+    }
+    else if (setting == Scene::POWER)
+    {
+      step.target = target? 1 : 0;
+      step.presses = (step.target != predicted[Scene::POWER]);
+      if (step.presses && step.target)
+      {
+        predicted[Scene::HEATER] = predicted[Scene::FILTER] = predicted[Scene::BUBBLE] = predicted[Scene::JET] = false;
+      }
+    }
+    else if (powerOff)
+    {
+      step.outcome = OUTCOME::CONFLICT;
+    }
+    else if (model != MODEL::SJBHS && (setting == Scene::JET || setting == Scene::DISINFECTION))
+    {
+      step.outcome = OUTCOME::UNSUPPORTED;
+    }
+    else if (setting == Scene::DISINFECTION)
+    {
+      step.target = nearestDisinfectionTime(target);
+    }
+    else if (setting == Scene::WATER_TEMP)
+    {
+      if (target < WATER_TEMP::SET_MIN || target > WATER_TEMP::SET_MAX)
+      {
+        step.outcome = OUTCOME::UNSUPPORTED;
+      }
+    }
+    else
+    {
+      step.target = target? 1 : 0;
+      if (setting == Scene::FILTER && !step.target && predicted[Scene::HEATER])
+      {
+        // heater requires filter
+        step.outcome = OUTCOME::CONFLICT;
+      }
+      else
+      {
+        step.presses = (step.target != predicted[setting]);
+        predicted[setting] = step.target;
+        if (setting == Scene::HEATER && step.target)
+        {
+          predicted[Scene::FILTER] = true;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+/**
+ * @param step planned step
+ * @return true if current status matches target of step
+ */
+bool PureSpaIO::isSceneStepReached(const SceneResult::Step& step) const
+{
+  switch (step.setting)
+  {
+    case Scene::POWER:        return isPowerOn() == step.target;
+    case Scene::HEATER:       return isHeaterOn() == step.target;
+    case Scene::FILTER:       return isFilterOn() == step.target;
+    case Scene::BUBBLE:       return isBubbleOn() == step.target;
+    case Scene::JET:          return isJetOn() == step.target;
+    case Scene::DISINFECTION: return getDisinfectionTime() == step.target;
+    case Scene::WATER_TEMP:   return getDesiredWaterTempCelsius() == step.target;
+    default:                  return false;
+  }
+}
+
+volatile unsigned int& PureSpaIO::getButton(uint8 setting)
+{
+  switch (setting)
+  {
+    case Scene::POWER:  return buttons.togglePower;
+    case Scene::HEATER: return buttons.toggleHeater;
+    case Scene::FILTER: return buttons.toggleFilter;
+    case Scene::BUBBLE: return buttons.toggleBubble;
+    default:            return buttons.toggleJet;
+  }
+}
+
+/**
+ * apply multiple settings with a single planned button sequence (blocking)
+ *
+ * notes:
+ * - toggle buttons are pressed back-to-back and only acknowledged by beep,
+ *   the LED status of all toggled settings is confirmed afterwards in one wait
+ * - a failed power press fails all following steps
+ *
+ * @param scene requested settings
+ * @param result per step outcome and total duration
+ */
+void PureSpaIO::setScene(const Scene& scene, SceneResult& result)
+{
+  unsigned long startTime = millis();
+  result.count = planScene(scene, result.steps);
+
+  // toggle buttons
+  bool powerFailed = false;
+  for (unsigned int i=0; i<result.count; i++)
+  {
+    SceneResult::Step& step = result.steps[i];
+    if (step.outcome == OUTCOME::PLANNED && step.setting < Scene::DISINFECTION)
+    {
+      unsigned long stepTime = millis();
+      unsigned int presses = buttonPresses;
+      if (powerFailed || (step.presses && !pressButton(getButton(step.setting))))
+      {
+        step.outcome = OUTCOME::FAILED;
+        powerFailed |= step.setting == Scene::POWER;
+      }
+      step.presses = diff(buttonPresses, presses);
+      step.duration = timeDiff(millis(), stepTime);
+    }
+  }
+
+  // confirm LED status of all toggles
+  auto pending = [this, &result]() -> bool
+  {
+    for (unsigned int i=0; i<result.count; i++)
+    {
+      const SceneResult::Step& step = result.steps[i];
+      if (step.outcome == OUTCOME::PLANNED && step.setting < Scene::DISINFECTION && !isSceneStepReached(step))
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+  esp_delay(SCENE::CONFIRM_TIMEOUT, pending, CYCLE::PERIOD);
+
+  for (unsigned int i=0; i<result.count; i++)
+  {
+    SceneResult::Step& step = result.steps[i];
+    if (step.outcome == OUTCOME::PLANNED && step.setting < Scene::DISINFECTION)
+    {
+      step.outcome = isSceneStepReached(step)? OUTCOME::CONFIRMED : OUTCOME::UNCONFIRMED;
+    }
+  }
+
+  // settings with display readback
+  for (unsigned int i=0; i<result.count; i++)
   {
-    delay(BUTTON::ACK_CHECK_PERIOD);
-    tries--;
+    SceneResult::Step& step = result.steps[i];
+    if (step.outcome == OUTCOME::PLANNED)
+    {
+      unsigned long stepTime = millis();
+      unsigned int presses = buttonPresses;
+      if (powerFailed)
+      {
+        step.outcome = OUTCOME::FAILED;
+      }
+      else
+      {
+        if (step.setting == Scene::DISINFECTION)
+        {
+          setDisinfectionTime(step.target);
+        }
+        else
+        {
+          setDesiredWaterTempCelsius(step.target);
+        }
+        step.outcome = isSceneStepReached(step)? OUTCOME::CONFIRMED : OUTCOME::UNCONFIRMED;
+      }
+      step.presses = diff(buttonPresses, presses);
+      step.duration = timeDiff(millis(), stepTime);
+    }
   }
-  bool success = state.buzzer;
-  WiFi.setSleepMode(WIFI_NONE_SLEEP);
 
-  return success;
-}
+  result.duration = timeDiff(millis(), startTime);
 
-void PureSpaIO::setBubbleOn(bool on)
-{
-  if (on ^ (isBubbleOn() == true))
+  // command outcome is outcome of first step not confirmed
+  commandResult.outcome = result.count? OUTCOME::CONFIRMED : OUTCOME::FAILED;
+  for (unsigned int i=0; i<result.count && commandResult.outcome == OUTCOME::CONFIRMED; i++)
   {
-    pressButton(buttons.toggleBubble);
+    commandResult.outcome = result.steps[i].outcome;
   }
 }
 
-void PureSpaIO::setFilterOn(bool on)
+/**
+ * print scene result as JSON
+ *
+ * @param out stream
+ * @param result
+ * @return number of bytes printed
+ */
+size_t PureSpaIO::printSceneResult(Print& out, const SceneResult& result) const
 {
-  if (on ^ (isFilterOn() == true))
+  bool success = result.count > 0;
+  for (unsigned int i=0; i<result.count; i++)
   {
-    pressButton(buttons.toggleFilter);
+    success &= result.steps[i].outcome == OUTCOME::CONFIRMED;
   }
-}
 
-void PureSpaIO::setHeaterOn(bool on)
-{
-  if (on ^ (isHeaterOn() == true || isHeaterStandby() == true))
+  size_t size = out.printf_P(PSTR("{\"duration\":%lu,\"success\":%s,\"steps\":["), result.duration, success? "true" : "false");
+  for (unsigned int i=0; i<result.count; i++)
   {
-    pressButton(buttons.toggleHeater);
+    const SceneResult::Step& step = result.steps[i];
+    size += out.printf_P(PSTR("%s{\"setting\":\"%s\",\"target\":%d,\"presses\":%u,\"outcome\":\"%s\",\"duration\":%lu}"),
+                         i? "," : "", getSceneSettingName(step.setting), step.target, step.presses,
+                         getOutcomeName(step.outcome), step.duration);
   }
-}
+  size += out.print("]}");
 
-void PureSpaIO::setJetOn(bool on)
-{
-  if (on ^ (isJetOn() == true))
-  {
-    pressButton(buttons.toggleJet);
-  }
+  return size;
 }
 
-void PureSpaIO::setPowerOn(bool on)
+/**
+ * let the radio policy select the WiFi sleep mode for a button command
+ *
+ * @param active true before pressing a button, false after acknowledge or timeout
+ */
+void PureSpaIO::setCommandActive(bool active)
 {
-  bool active = isPowerOn() == true;
-  if (on ^ active)
+  if (radioPolicy)
   {
-    pressButton(buttons.togglePower);
+    radioPolicy->setCommandActive(active);
   }
 }
 
@@ -685,15 +1779,10 @@ void PureSpaIO::setPowerOn(bool on)
  */
 bool PureSpaIO::waitBuzzerOff() const
 {
-  int tries = BUTTON::ACK_TIMEOUT/BUTTON::ACK_CHECK_PERIOD;
-  while (state.buzzer && tries)
-  {
-    delay(BUTTON::ACK_CHECK_PERIOD);
-    tries--;
-  }
+  esp_delay(BUTTON::ACK_TIMEOUT, []() -> bool { return state.buzzer; });
 
   // extra delay reduces chance to trigger auto repeat
-  if (tries)
+  if (!state.buzzer)
   {
     delay(2*CYCLE::PERIOD);
     return true;
@@ -709,7 +1798,7 @@ bool PureSpaIO::waitBuzzerOff() const
  * change water temperature setpoint by 1 degree and wait for confirmation (blocking)
  *
  * notes:
- * - WiFi is temporarily put to sleep to improve receive decoding reliability
+ * - WiFi sleep mode is selected by the radio policy to improve receive decoding reliability
  *
  * @param up press up (> 0) or down (< 0) button
  * @return true if beep was received, false if no beep was received until timeout
@@ -724,44 +1813,31 @@ bool PureSpaIO::changeWaterTemp(int up)
     waitBuzzerOff();
 
 #ifndef FORCE_WIFI_SLEEP
-    WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
+    setCommandActive(true);
 #endif
 
     // perform button action
-    int tries = BUTTON::PRESS_SHORT_COUNT*CYCLE::PERIOD/BUTTON::ACK_CHECK_PERIOD;
+    buttonPresses++;
     if (up > 0)
     {
       buttons.toggleTempUp = BUTTON::PRESS_SHORT_COUNT;
-      while (buttons.toggleTempUp && tries)
-      {
-        delay(BUTTON::ACK_CHECK_PERIOD);
-        tries--;
-      }
+      esp_delay(BUTTON::PRESS_SHORT_COUNT*CYCLE::PERIOD, []() -> bool { return buttons.toggleTempUp != 0; });
       buttons.toggleTempUp = 0;
     }
     else if (up < 0)
     {
       buttons.toggleTempDown = BUTTON::PRESS_SHORT_COUNT;
-      while (buttons.toggleTempDown && tries)
-      {
-        delay(BUTTON::ACK_CHECK_PERIOD);
-        tries--;
-      }
+      esp_delay(BUTTON::PRESS_SHORT_COUNT*CYCLE::PERIOD, []() -> bool { return buttons.toggleTempDown != 0; });
       buttons.toggleTempDown = 0;
     }
 
     // wait for buzzer on
-    tries = (BUTTON::PRESS_COUNT - BUTTON::PRESS_SHORT_COUNT)*CYCLE::PERIOD/BUTTON::ACK_CHECK_PERIOD;
-    while (!state.buzzer && tries)
-    {
-      delay(BUTTON::ACK_CHECK_PERIOD);
-      tries--;
-    }
+    esp_delay((BUTTON::PRESS_COUNT - BUTTON::PRESS_SHORT_COUNT)*CYCLE::PERIOD, []() -> bool { return !state.buzzer; });
 
     success = state.buzzer;
 
 #ifndef FORCE_WIFI_SLEEP
-    WiFi.setSleepMode(WIFI_NONE_SLEEP);
+    setCommandActive(false);
 #endif
 
     if (!success)
@@ -792,10 +1868,24 @@ int PureSpaIO::convertDisplayToCelsius(uint32 value) const
   return (celsiusValue >= 0) && (celsiusValue <= 60) ? celsiusValue : UNDEF::INT;
 }
 
+template<PureSpaIO::MODEL M>
 IRAM_ATTR void PureSpaIO::clockRisingISR(void* arg)
 {
-  bool data = !digitalRead(PIN::DATA);
-  bool enabled = !digitalRead(PIN::LATCH);
+  uint32 startCycles = ESP.getCycleCount();
+#ifdef ISR_PROFILING
+  bool frameComplete = false;
+#endif
+  // sample data and latch at the same time via GPIO input register
+  uint32 gpi = GPI;
+  bool data = !(gpi & bit(PIN::DATA));
+  bool enabled = !(gpi & bit(PIN::LATCH));
+  state.clockEdges++;
+  state.latchEdges += enabled;
+  if (state.wakeOnClock)
+  {
+    state.wakeOnClock = false;
+    esp_schedule();
+  }
 
   if (enabled || isrState.receivedBits == (FRAME::BITS - 1))
   {
@@ -805,6 +1895,11 @@ IRAM_ATTR void PureSpaIO::clockRisingISR(void* arg)
     if (isrState.receivedBits == FRAME::BITS)
     {
       state.frameCounter++;
+      state.completeFrames++;
+      if (capture.buffer && isrState.frameValue != FRAME_TYPE::CUE)
+      {
+        recordFrame();
+      }
       if (isrState.frameValue == FRAME_TYPE::CUE)
       {
         // cue frame, ignore
@@ -821,29 +1916,180 @@ IRAM_ATTR void PureSpaIO::clockRisingISR(void* arg)
         // LED frame
         //DEBUG_MSG("\nL");
         decodeLED();
+        if (M == MODEL::UNKNOWN)
+        {
+          detectModel();
+        }
       }
-      else if (isrState.frameValue & FRAME_TYPE::BUTTON)
+      else if (isrState.frameValue & FRAME_BUTTON<M>::TYPE)
       {
         // button frame
         //DEBUG_MSG("\nB");
-        decodeButton();
+        if (M == MODEL::UNKNOWN)
+        {
+          isrState.buttonFrames++;
+        }
+        else
+        {
+          decodeButton<M>(startCycles);
+        }
       }
       else if (isrState.frameValue != 0)
       {
         // unsupported frame
         //DEBUG_MSG("\nU");
+        state.unsupportedFrames++;
       }
 
       isrState.receivedBits = 0;
+#ifdef ISR_PROFILING
+      frameComplete = true;
+#endif
     }
   }
   else
   {
     //DEBUG_MSG(" %d ", receivedBits);
+    if (isrState.receivedBits)
+    {
+      // framing error, latch disabled before frame was complete
+      state.frameDropped++;
+    }
     isrState.receivedBits = 0;
     state.frameCounter++;
   }
+
+#ifdef ISR_PROFILING
+  uint32 endCycles = ESP.getCycleCount();
+  profileEdge<M>(endCycles - startCycles, frameComplete);
+  if (isrProfile.replyArmed)
+  {
+    profileSample(PROFILE::REPLY_EXIT, endCycles - startCycles);
+    isrProfile.replyArmed = false;
+  }
+#endif
+}
+
+/**
+ * timer1 ISR generating the reply pulse: the first interrupt pulls the data
+ * line low by enabling its push-pull output driver (output value is low),
+ * the second interrupt 3 µs later (REPLY::PULSE_TICKS) releases it
+ *
+ * note: the pulse MUST be completed BEFORE next falling edge of clock
+ */
+IRAM_ATTR void PureSpaIO::replyTimerISR()
+{
+  if (!isrState.replyPulse)
+  {
+    GPES = bit(PIN::DATA);
+    isrState.replyPulse = true;
+    timer1_write(REPLY::PULSE_TICKS);
+#ifdef ISR_PROFILING
+    isrProfile.replyStartCycles = ESP.getCycleCount();
+    profileSample(PROFILE::REPLY_DELAY, isrProfile.replyStartCycles - isrProfile.replyEntryCycles);
+#endif
+  }
+  else
+  {
+    GPEC = bit(PIN::DATA);
+    isrState.replyPulse = false;
+#ifdef ISR_PROFILING
+    profileSample(PROFILE::REPLY_PULSE, ESP.getCycleCount() - isrProfile.replyStartCycles);
+#endif
+  }
+}
+
+IRAM_ATTR inline void PureSpaIO::recordFrame()
+{
+  if (!capture.frozen)
+  {
+    unsigned long now = micros();
+    unsigned long delta = now - capture.lastTime;
+    capture.buffer[capture.head] = ((delta < USHRT_MAX? delta : USHRT_MAX) << 16) | isrState.frameValue;
+    capture.lastTime = now;
+    capture.head = (capture.head + 1 < capture.size)? capture.head + 1 : 0;
+    if (capture.count < capture.size)
+    {
+      capture.count++;
+    }
+    if (capture.remaining && --capture.remaining == 0)
+    {
+      capture.frozen = true;
+    }
+  }
+}
+
+/**
+ * record time of command stage once per command
+ *
+ * @param stage
+ */
+IRAM_ATTR inline void PureSpaIO::markCommandStage(volatile uint32& stage)
+{
+  if (commandTiming.start && !stage)
+  {
+    uint32 now = micros();
+    stage = now? now : 1;
+  }
+}
+
+/**
+ * flag confirmed change of pool state and wake up loop
+ */
+IRAM_ATTR inline void PureSpaIO::signalStateChange()
+{
+  state.stateChanged = true;
+  esp_schedule();
+}
+
+#ifdef ISR_PROFILING
+template<PureSpaIO::MODEL M>
+IRAM_ATTR inline void PureSpaIO::profileEdge(uint32 cycles, bool frameComplete)
+{
+  unsigned int type;
+  if (!frameComplete)
+  {
+    type = PROFILE::BIT_EDGE;
+  }
+  else if (isrState.frameValue == FRAME_TYPE::CUE)
+  {
+    type = PROFILE::CUE_FRAME;
+  }
+  else if (isrState.frameValue & FRAME_TYPE::DIGIT)
+  {
+    type = PROFILE::DIGIT_FRAME;
+  }
+  else if (isrState.frameValue & FRAME_TYPE::LED)
+  {
+    type = PROFILE::LED_FRAME;
+  }
+  else if (isrState.frameValue & FRAME_BUTTON<M>::TYPE)
+  {
+    type = PROFILE::BUTTON_FRAME;
+  }
+  else
+  {
+    type = PROFILE::OTHER_FRAME;
+  }
+
+  profileSample(type, cycles);
+  if (cycles > BUDGET_CYCLES)
+  {
+    isrProfile.overBudget++;
+  }
+}
+
+IRAM_ATTR inline void PureSpaIO::profileSample(unsigned int type, uint32 cycles)
+{
+  volatile ProfileStats& stats = isrProfile.stats[type];
+  stats.count++;
+  stats.sum += cycles;
+  if (cycles > stats.max)
+  {
+    stats.max = cycles;
+  }
 }
+#endif
 
 IRAM_ATTR inline void PureSpaIO::decodeDisplay()
 {
@@ -904,6 +2150,7 @@ IRAM_ATTR inline void PureSpaIO::decodeDisplay()
 
     default:
       // unsupported, ignore
+      state.invalidDigits++;
       return;
   }
 
@@ -945,182 +2192,254 @@ IRAM_ATTR inline void PureSpaIO::decodeDisplay()
 
   if (isrState.receivedDigits == DIGIT::POS_ALL)
   {
-    if (isrState.displayValue == isrState.latestDisplayValue)
+    // collect digit group for majority vote at end of cycle,
+    // vote early if more groups than expected are received
+    isrState.groupValues[isrState.groupCount++] = isrState.displayValue;
+    isrState.receivedDigits = 0;
+    if (isrState.groupCount == CYCLE::DISPLAY_FRAME_GROUPS)
+    {
+      voteDisplay();
+    }
+  }
+  // else not all digits set yet
+}
+
+IRAM_ATTR inline void PureSpaIO::voteDisplay()
+{
+  // majority candidate of digit groups (Boyer-Moore)
+  uint32 candidate = isrState.groupValues[0];
+  unsigned int votes = 0;
+  for (unsigned int i=0; i<isrState.groupCount; i++)
+  {
+    if (votes == 0)
+    {
+      candidate = isrState.groupValues[i];
+      votes = 1;
+    }
+    else if (isrState.groupValues[i] == candidate)
+    {
+      votes++;
+    }
+    else
+    {
+      votes--;
+    }
+  }
+
+  // verify candidate
+  votes = 0;
+  for (unsigned int i=0; i<isrState.groupCount; i++)
+  {
+    if (isrState.groupValues[i] == candidate)
+    {
+      votes++;
+    }
+  }
+  state.displayGroupErrors += isrState.groupCount - votes;
+  isrState.groupCount = 0;
+  isrState.cycleTime = millis();
+  state.cycleCounter++;
+
+  if (votes >= CYCLE::DISPLAY_MAJORITY)
+  {
+    isrState.displayValue = candidate;
+    decodeDisplayValue();
+  }
+  else
+  {
+    // no majority, ignore cycle
+    state.displayVoteFailures++;
+  }
+}
+
+IRAM_ATTR inline void PureSpaIO::decodeDisplayValue()
+{
+  if (isrState.displayValue == isrState.latestDisplayValue)
+  {
+    // display is stable, might be blinking
+    //DEBUG_MSG(" s%x", isrState.displayValue);
+    isrState.stableDisplayValueCount--;
+    if (isrState.stableDisplayValueCount == 0)
     {
-      // display is stable, might be blinking
-      //DEBUG_MSG(" s%x", isrState.displayValue);
-      isrState.stableDisplayValueCount--;
-      if (isrState.stableDisplayValueCount == 0)
+      //DEBUG_MSG(" C"); // confirmed
+      isrState.stableDisplayValueCount = state.confirmCycles;
+      if (isrState.isDisplayBlinking)
       {
-        //DEBUG_MSG(" C"); // confirmed
-        isrState.stableDisplayValueCount = CONFIRM_FRAMES::REGULAR;
-        if (isrState.isDisplayBlinking)
+        //DEBUG_MSG("B");
+        if (timeDiff(isrState.cycleTime, isrState.lastBlankDisplayTime) > BLINK::STOPPED_DURATION)
         {
-          //DEBUG_MSG("B");
-          if (diff(state.frameCounter, isrState.lastBlankDisplayFrameCounter) > BLINK::STOPPED_FRAMES)
-          {
-            // blinking is over, clear desired temp
-            //DEBUG_MSG("b");
-            isrState.isDisplayBlinking = false;
-            isrState.latestBlinkingTemp = UNDEF::UINT;
-          }
+          // blinking is over, clear desired temp
+          //DEBUG_MSG("b");
+          isrState.isDisplayBlinking = false;
+          isrState.latestBlinkingTemp = UNDEF::UINT;
         }
+      }
 
-        if (!displayIsError(isrState.displayValue))
+      if (!displayIsError(isrState.displayValue))
+      {
+        // display does not show an error
+        //DEBUG_MSG("e");
+        // display shows a time only on SJB-HS
+        if (displayIsTime(isrState.displayValue))
         {
-          // display does not show an error
-          //DEBUG_MSG("e");
-#ifdef MODEL_SJB_HS
-          if (displayIsTime(isrState.displayValue))
+          // display shows a time
+          //DEBUG_MSG("C");
+          if (isrState.displayValue == isrState.latestDisinfectionTime)
           {
-            // display shows a time
-            //DEBUG_MSG("C");
-            if (isrState.displayValue == isrState.latestDisinfectionTime)
+            // new time is stable
+            //DEBUG_MSG("C%d", stableWaterTempCount);
+            isrState.stableDisinfectionTimeCount--;
+            if (isrState.stableDisinfectionTimeCount == 0)
             {
-              // new time is stable
-              //DEBUG_MSG("C%d", stableWaterTempCount);
-              isrState.stableDisinfectionTimeCount--;
-              if (isrState.stableDisinfectionTimeCount == 0)
+              // save time
+              if (state.disinfectionTime != isrState.displayValue)
               {
-                // save time
-                if (state.disinfectionTime != isrState.displayValue)
-                {
-                  //DEBUG_MSG(" AC ");
-                  state.disinfectionTime = isrState.displayValue;
-                }
-
-                isrState.stableDisinfectionTimeCount = CONFIRM_FRAMES::REGULAR;
+                //DEBUG_MSG(" AC ");
+                state.disinfectionTime = isrState.displayValue;
+                signalStateChange();
               }
-            }
-            else
-            {
-              // time has changed
-              //DEBUG_MSG("c");
-              isrState.latestDisinfectionTime = isrState.displayValue;
-              isrState.stableWaterTempCount = CONFIRM_FRAMES::NOT_BLINKING;
+
+              isrState.stableDisinfectionTimeCount = state.confirmCycles;
             }
           }
           else
-#endif
           {
-            if (displayIsTemp(isrState.displayValue))
+            // time has changed
+            //DEBUG_MSG("c");
+            isrState.latestDisinfectionTime = isrState.displayValue;
+            isrState.stableWaterTempCount = state.notBlinkingCycles + state.confirmCycles - CONFIRM_CYCLES::MIN;
+          }
+        }
+        else
+        {
+          if (displayIsTemp(isrState.displayValue))
+          {
+            // display shows a temperature
+            //DEBUG_MSG("T");
+            if (isrState.isDisplayBlinking)
             {
-              // display shows a temperature
-              //DEBUG_MSG("T");
-              if (isrState.isDisplayBlinking)
+              // display is blinking
+              //DEBUG_MSG("B");
+              if (isrState.displayValue == isrState.latestBlinkingTemp)
               {
-                // display is blinking
-                //DEBUG_MSG("B");
-                if (isrState.displayValue == isrState.latestBlinkingTemp)
-                {
-                  // blinking temp is stable
-                  isrState.stableBlinkingWaterTempCount++;
-                  //DEBUG_MSG("DS ");
-                }
-                else if (diff(state.frameCounter, isrState.lastBlankDisplayFrameCounter) < BLINK::TEMP_FRAMES)
-                {
-                  // blinking temp has changed (is read after a blank screen and set at next black screen)
-                  //DEBUG_MSG("DC ");
-                  isrState.latestBlinkingTemp = isrState.displayValue;
-                  isrState.stableBlinkingWaterTempCount = 0;
-                }
+                // blinking temp is stable
+                isrState.stableBlinkingWaterTempCount++;
+                //DEBUG_MSG("DS ");
               }
-              else
+              else if (timeDiff(isrState.cycleTime, isrState.lastBlankDisplayTime) < BLINK::TEMP_DURATION)
               {
-                // display is not blinking
-                //DEBUG_MSG("b");
-                if (isrState.displayValue == isrState.latestWaterTemp)
+                // blinking temp has changed (is read after a blank screen and set at next black screen)
+                //DEBUG_MSG("DC ");
+                isrState.latestBlinkingTemp = isrState.displayValue;
+                isrState.stableBlinkingWaterTempCount = 0;
+              }
+            }
+            else
+            {
+              // display is not blinking
+              //DEBUG_MSG("b");
+              if (isrState.displayValue == isrState.latestWaterTemp)
+              {
+                // new actual temp is stable
+                //DEBUG_MSG("A ");
+                isrState.stableWaterTempCount--;
+                if (isrState.stableWaterTempCount == 0)
                 {
-                  // new actual temp is stable
-                  //DEBUG_MSG("A ");
-                  isrState.stableWaterTempCount--;
-                  if (isrState.stableWaterTempCount == 0)
+                  // save actual temp
+                  if (state.waterTemp != isrState.displayValue)
                   {
-                    // save actual temp
-                    if (state.waterTemp != isrState.displayValue)
-                    {
-                      //DEBUG_MSG(" T");
-                      state.waterTemp = isrState.displayValue;
-                    }
-
-                    isrState.stableWaterTempCount = CONFIRM_FRAMES::NOT_BLINKING;
+                    //DEBUG_MSG(" T");
+                    state.waterTemp = isrState.displayValue;
+                    signalStateChange();
                   }
-                }
-                else
-                {
-                  // actual temp is changed
-                  //DEBUG_MSG("a ");
-                  isrState.latestWaterTemp = isrState.displayValue;
-                  isrState.stableWaterTempCount = CONFIRM_FRAMES::NOT_BLINKING;
+
+                  isrState.stableWaterTempCount = state.notBlinkingCycles + state.confirmCycles - CONFIRM_CYCLES::MIN;
                 }
               }
+              else
+              {
+                // actual temp is changed
+                //DEBUG_MSG("a ");
+                isrState.latestWaterTemp = isrState.displayValue;
+                isrState.stableWaterTempCount = state.notBlinkingCycles + state.confirmCycles - CONFIRM_CYCLES::MIN;
+              }
             }
-            else
-            {
-              // unsupported display state (no error, no temperature)
-              //DEBUG_MSG("t ");
-            }
+          }
+          else
+          {
+            // unsupported display state (no error, no temperature)
+            //DEBUG_MSG("t ");
           }
         }
-        else
+      }
+      else
+      {
+        // display shows error code
+        if (state.error != display2Error(isrState.displayValue))
         {
-          // display shows error code
           state.error = display2Error(isrState.displayValue);
+          signalStateChange();
         }
       }
     }
-    else if (displayIsBlank(isrState.displayValue))
+  }
+  else if (displayIsBlank(isrState.displayValue))
+  {
+    // display is blank
+    if (isrState.stableDisplayBlankCount)
+    {
+      isrState.stableDisplayBlankCount--;
+    }
+    else
     {
       // display is blank
-      if (isrState.stableDisplayBlankCount)
-      {
-        isrState.stableDisplayBlankCount--;
-      }
-      else
+      //DEBUG_MSG("B");
+      if (isrState.isDisplayBlinking)
       {
-        // display is blank
-        //DEBUG_MSG("B");
-        if (isrState.isDisplayBlinking)
+        // already blinking
+        if (isrState.latestBlinkingTemp != UNDEF::UINT)
         {
-          // already blinking
-          if (isrState.latestBlinkingTemp != UNDEF::UINT)
-          {
-            // new temp
-            //DEBUG_MSG("bc ");
-            isrState.blankCounter++;
-          }
+          // new temp
+          //DEBUG_MSG("bc ");
+          isrState.blankCounter++;
+        }
 
-          // if display was already blinking several times, save desired temp
-          // otherwise could be start of error
-          if (state.error == ERROR_NONE && isrState.blankCounter > 2
-              && isrState.stableBlinkingWaterTempCount >= CONFIRM_FRAMES::REGULAR
-              && state.desiredTemp != isrState.latestBlinkingTemp)
+        // if the value phase between two blank phases matches the blink period,
+        // save desired temp, otherwise could be start of error
+        unsigned long valueDuration = timeDiff(isrState.cycleTime, isrState.lastBlankDisplayTime);
+        if (state.error == ERROR_NONE && isrState.blankCounter > 0
+            && valueDuration >= BLINK::PHASE_MIN && valueDuration <= BLINK::PHASE_MAX
+            && isrState.stableBlinkingWaterTempCount >= state.confirmCycles)
+        {
+          //DEBUG_MSG("\nDT%x ", isrState.displayValue);
+          if (state.desiredTemp != isrState.latestBlinkingTemp)
           {
-            //DEBUG_MSG("\nDT%x ", isrState.displayValue);
             state.desiredTemp = isrState.latestBlinkingTemp;
+            signalStateChange();
+            markCommandStage(commandTiming.confirm);
           }
-
-          isrState.latestBlinkingTemp = UNDEF::UINT;
-          isrState.stableBlinkingWaterTempCount = 0;
+          state.desiredTempConfirmed = true;
         }
-        else
-        {
-          // blinking start
-          isrState.isDisplayBlinking = true;
-          isrState.blankCounter = 0;
-        }
-        isrState.lastBlankDisplayFrameCounter = state.frameCounter;
+
+        isrState.latestBlinkingTemp = UNDEF::UINT;
+        isrState.stableBlinkingWaterTempCount = 0;
       }
-    }
-    else
-    {
-      // display value changed
-      isrState.latestDisplayValue = isrState.displayValue;
-      isrState.stableDisplayValueCount = CONFIRM_FRAMES::REGULAR;
-      isrState.stableDisplayBlankCount = CONFIRM_FRAMES::REGULAR;
+      else
+      {
+        // blinking start
+        isrState.isDisplayBlinking = true;
+        isrState.blankCounter = 0;
+      }
+      isrState.lastBlankDisplayTime = isrState.cycleTime;
     }
   }
-  // else not all digits set yet
+  else
+  {
+    // display value changed
+    isrState.latestDisplayValue = isrState.displayValue;
+    isrState.stableDisplayValueCount = state.confirmCycles;
+    isrState.stableDisplayBlankCount = state.confirmCycles;
+  }
 }
 
 ICACHE_RAM_ATTR inline void PureSpaIO::decodeLED()
@@ -1132,10 +2451,30 @@ ICACHE_RAM_ATTR inline void PureSpaIO::decodeLED()
     if (isrState.stableLedStatusCount == 0)
     {
       //DEBUG_MSG("\nL%x", frameValue);
-      state.ledStatus = isrState.frameValue;
-      state.buzzer = !(state.ledStatus & FRAME_LED::NO_BEEP);
+      if (state.ledStatus != isrState.frameValue)
+      {
+        if ((state.ledStatus ^ isrState.frameValue) & ~FRAME_LED<MODEL::SBH20>::NO_BEEP)
+        {
+          state.ledChanges++;
+          markCommandStage(commandTiming.confirm);
+        }
+        state.ledStatus = isrState.frameValue;
+        signalStateChange();
+      }
+      bool buzzer = !(state.ledStatus & FRAME_LED<MODEL::SBH20>::NO_BEEP);
+      if (buzzer != state.buzzer)
+      {
+        // wake up loop waiting for button acknowledge
+        state.buzzer = buzzer;
+        state.buzzerAcks += buzzer;
+        esp_schedule();
+      }
+      if (state.buzzer)
+      {
+        markCommandStage(commandTiming.ack);
+      }
       state.stateUpdated = true;
-      isrState.stableLedStatusCount = CONFIRM_FRAMES::REGULAR;
+      isrState.stableLedStatusCount = state.confirmFrames;
 
       // clear buttons if buzzer is on
       if (state.buzzer)
@@ -1155,7 +2494,7 @@ ICACHE_RAM_ATTR inline void PureSpaIO::decodeLED()
   {
     // LED status changed
     isrState.latestLedStatus = isrState.frameValue;
-    isrState.stableLedStatusCount = CONFIRM_FRAMES::REGULAR;
+    isrState.stableLedStatusCount = state.confirmFrames;
   }
 }
 
@@ -1171,53 +2510,103 @@ IRAM_ATTR inline void PureSpaIO::updateButtonState(volatile unsigned int& button
     {
       isrState.reply = true;
       buttonPressCount--;
+      markCommandStage(commandTiming.reply);
+      if (buttonPressCount == 0)
+      {
+        // wake up loop waiting for button completion
+        esp_schedule();
+      }
+    }
+  }
+}
+
+/**
+ * count button frames between LED frames, the model is detected when the
+ * same number is seen in several consecutive cycles, a stable number that
+ * matches no model is counted as detection failure
+ */
+IRAM_ATTR inline void PureSpaIO::detectModel()
+{
+  if (isrState.buttonFrames)
+  {
+    if (isrState.buttonFrames == isrState.detectionButtonFrames)
+    {
+      if (isrState.detectionCount < MODEL_DETECTION::CYCLES)
+      {
+        isrState.detectionCount++;
+      }
+      if (isrState.detectionCount >= MODEL_DETECTION::CYCLES)
+      {
+        if (isrState.buttonFrames == FRAME_BUTTON<MODEL::SBH20>::FRAMES)
+        {
+          state.detectedModel = MODEL::SBH20;
+          esp_schedule();
+        }
+        else if (isrState.buttonFrames == FRAME_BUTTON<MODEL::SJBHS>::FRAMES)
+        {
+          state.detectedModel = MODEL::SJBHS;
+          esp_schedule();
+        }
+        else if (!isrState.detectionFailed)
+        {
+          // stable but unsupported number of button frames, count once
+          state.detectionFailures++;
+          isrState.detectionFailed = true;
+        }
+      }
     }
+    else
+    {
+      isrState.detectionButtonFrames = isrState.buttonFrames;
+      isrState.detectionCount = 0;
+      isrState.detectionFailed = false;
+    }
+    isrState.buttonFrames = 0;
   }
 }
 
-IRAM_ATTR inline void PureSpaIO::decodeButton()
+template<PureSpaIO::MODEL M>
+IRAM_ATTR inline void PureSpaIO::decodeButton(uint32 startCycles)
 {
-  if (isrState.frameValue & FRAME_BUTTON::FILTER)
+  if (isrState.frameValue & FRAME_BUTTON<M>::FILTER)
   {
     //DEBUG_MSG("F");
     updateButtonState(buttons.toggleFilter);
   }
-  else if (isrState.frameValue & FRAME_BUTTON::HEATER)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::HEATER)
   {
     //DEBUG_MSG("H");
     updateButtonState(buttons.toggleHeater);
   }
-  else if (isrState.frameValue & FRAME_BUTTON::BUBBLE)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::BUBBLE)
   {
     //DEBUG_MSG("B");
     updateButtonState(buttons.toggleBubble);
   }
-  else if (isrState.frameValue & FRAME_BUTTON::POWER)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::POWER)
   {
     //DEBUG_MSG(" P");
     updateButtonState(buttons.togglePower);
   }
-  else if (isrState.frameValue & FRAME_BUTTON::TEMP_UP)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::TEMP_UP)
   {
     //DEBUG_MSG("U");
     updateButtonState(buttons.toggleTempUp);
   }
-  else if (isrState.frameValue & FRAME_BUTTON::TEMP_DOWN)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::TEMP_DOWN)
   {
     //DEBUG_MSG("D");
     updateButtonState(buttons.toggleTempDown);
   }
-#ifdef MODEL_SJB_HS
-  else if (isrState.frameValue & FRAME_BUTTON::DISINFECTION)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::DISINFECTION)
   {
     updateButtonState(buttons.toggleDisinfection);
   }
-  else if (isrState.frameValue & FRAME_BUTTON::JET)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::JET)
   {
     updateButtonState(buttons.toggleJet);
   }
-#endif
-  else if (isrState.frameValue & FRAME_BUTTON::TEMP_UNIT)
+  else if (isrState.frameValue & FRAME_BUTTON<M>::TEMP_UNIT)
   {
     //DEBUG_MSG("T");
   }
@@ -1228,17 +2617,22 @@ IRAM_ATTR inline void PureSpaIO::decodeButton()
 
   if (isrState.reply)
   {
-    // delay around 5 µs relative to rising edge of latch signal before pulsing
-    // pulse should be around 2 µs and MUST be completed BEFORE next falling edge of clock
-#if F_CPU == 160000000L
-    delayMicroseconds(1);
-    pinMode(PIN::DATA, OUTPUT);
-    delayMicroseconds(3);
-    pinMode(PIN::DATA, INPUT);
-#else
-    #error 160 MHz CPU frequency required! Pulse timing not possible at 80 MHz, because the code above takes too long to reach this point.
-    // at least using Arduino methods
+    // arm timer1 to start the reply pulse 2 µs after ISR entry (REPLY::DELAY_TICKS),
+    // the ISR returns immediately and the pulse is generated by replyTimerISR()
+    uint32 elapsed = (ESP.getCycleCount() - startCycles)/REPLY::CYCLES_PER_TICK;
+    uint32 ticks = REPLY::DELAY_TICKS > elapsed + REPLY::MIN_TICKS? REPLY::DELAY_TICKS - elapsed : REPLY::MIN_TICKS;
+    isrState.replyPulse = false;
+    timer1_write(ticks);
+#ifdef ISR_PROFILING
+    isrProfile.replyEntryCycles = startCycles;
+    isrProfile.replyArmed = true;
 #endif
     isrState.reply = false;
   }
+
+  // end of display part of cycle, vote over digit groups received
+  if (isrState.groupCount)
+  {
+    voteDisplay();
+  }
 }
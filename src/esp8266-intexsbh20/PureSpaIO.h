@@ -30,9 +30,12 @@
 #define PURE_SPA_IO_H
 
 #include <c_types.h>
+#include <Print.h>
 #include <WString.h>
 #include "common.h"
+#include "Metrics.h"
 
+class RadioPolicy;
 
 /**
  * The Intex serial protocol between the mainboard of the SB-H20 model and its
@@ -133,8 +136,9 @@ class PureSpaIO
 public:
   enum MODEL
   {
-    SBH20 = 1,
-    SJBHS = 2
+    UNKNOWN = 0,
+    SBH20   = 1,
+    SJBHS   = 2
   };
 
   class UNDEF
@@ -153,8 +157,25 @@ public:
     static const int SET_MAX = 40; // °C
   };
 
+  enum BUS_HEALTH
+  {
+    BUS_UNKNOWN = 0,
+    BUS_OK,
+    BUS_NO_CLOCK,   // no clock edges
+    BUS_LATCH_HIGH, // clock edges, but latch never active
+    BUS_LATCH_LOW,  // latch active on every clock edge
+    BUS_FRAMING,    // latch toggles, but no complete frame
+    BUS_DECODING    // complete frames, but most fail to decode
+  };
+
+  class BUS_CHECK
+  {
+  public:
+    static const unsigned int PERIOD = 42; // ms, 2 nominal frame cycles
+  };
+
 public:
-  void setup(LANG language);
+  void setup(LANG language, RadioPolicy& radioPolicy);
   void loop();
 
 public:
@@ -162,6 +183,17 @@ public:
   const char* getModelName() const;
 
   bool isOnline() const;
+  unsigned int getErrorRate() const;
+  void checkBusHealth();
+  BUS_HEALTH getBusHealth() const;
+  const char* getBusHealthName() const;
+  bool isBusSilent(unsigned long duration) const;
+  void setIdle(bool idle);
+  bool isWakeupPending();
+  bool isStateComplete() const;
+  bool isStateStale() const;
+  bool isStateChanged() const;
+  bool clearStateChanged();
 
   int getActWaterTempCelsius() const;
   int getDesiredWaterTempCelsius() const;
@@ -176,6 +208,18 @@ public:
   uint8 isJetOn() const;
   uint8 isPowerOn() const;
 
+  enum OUTCOME
+  {
+    PLANNED = 0,
+    CONFIRMED,   // setting reached
+    UNCONFIRMED, // button acknowledged, but setting not reached
+    FAILED,      // button not acknowledged or state unknown
+    CONFLICT,    // contradicts other setting of scene
+    UNSUPPORTED  // not available for model or out of range
+  };
+
+  static const char* getOutcomeName(uint8 outcome);
+
   void setDesiredWaterTempCelsius(int temp);
   void setDisinfectionTime(int hours);
 
@@ -185,26 +229,136 @@ public:
   void setJetOn(bool on);
   void setPowerOn(bool on);
 
-  String getErrorCode() const;
-  String getErrorMessage(const String& errorCode) const;
+  struct Scene
+  {
+    enum SETTING
+    {
+      POWER = 0,
+      HEATER,
+      FILTER,
+      BUBBLE,
+      JET,
+      DISINFECTION,
+      WATER_TEMP,
+      SETTINGS
+    };
+
+    Scene() { for (unsigned int i=0; i<SETTINGS; i++) target[i] = UNDEF::INT; }
+
+    int target[SETTINGS]; // on/off as 1/0, hours, °C or UNDEF::INT if not requested
+  };
+
+  struct SceneResult
+  {
+    struct Step
+    {
+      uint8 setting = 0;
+      uint8 outcome = OUTCOME::PLANNED;
+      uint8 presses = 0;
+      int target = UNDEF::INT;
+      unsigned long duration = 0; // ms
+    };
+
+    Step steps[Scene::SETTINGS];
+    unsigned int count = 0;
+    unsigned long duration = 0; // ms
+  };
+
+  static const char* getSceneSettingName(unsigned int setting);
+  void setScene(const Scene& scene, SceneResult& result);
+  size_t printSceneResult(Print& out, const SceneResult& result) const;
+
+  static const uint32 ERROR_NONE = 0;
+
+  uint32 getErrorCode() const;
+  const char* getErrorMessage(uint32 errorCode) const;
 
   unsigned int getRawLedValue() const;
 
   unsigned int getTotalFrames() const;
   unsigned int getDroppedFrames() const;
 
+  struct CommandTiming
+  {
+    uint32 start   = 0; // [µs] dispatch of command
+    uint32 reply   = 0; // [µs] first button frame answered
+    uint32 ack     = 0; // [µs] buzzer on
+    uint32 confirm = 0; // [µs] LED status or desired temp changed
+  };
+
+  void startCommandTiming(uint32 start);
+  void getCommandTiming(CommandTiming& timing) const;
+  void stopCommandTiming();
+
+  struct CommandResult
+  {
+    uint8 outcome          = OUTCOME::CONFIRMED;
+    unsigned int presses   = 0;
+    unsigned int retries   = 0; // presses repeated because previous press had no effect
+    unsigned int repeats   = 0; // auto repeat or double trigger events
+    unsigned long duration = 0; // ms
+  };
+
+  void startCommandResult();
+  void getCommandResult(CommandResult& result) const;
+
+  bool startCapture(unsigned int frames, bool ring = false);
+  void triggerCapture();
+  void stopCapture();
+  bool isCaptureComplete() const;
+  bool isCaptureFailed() const;
+  const uint32* getCapture(unsigned int& frames, unsigned int& first, unsigned int& size) const;
+
+#ifdef ISR_PROFILING
+public:
+  enum PROFILE
+  {
+    BIT_EDGE = 0,   // clock edge without complete frame
+    CUE_FRAME,
+    DIGIT_FRAME,
+    LED_FRAME,
+    BUTTON_FRAME,
+    OTHER_FRAME,
+    REPLY_DELAY,    // clock ISR entry until start of reply pulse by timer
+    REPLY_PULSE,    // width of reply pulse
+    REPLY_EXIT,     // clock ISR entry until exit after arming the reply timer
+    PROFILE_TYPES
+  };
+
+  struct ProfileStats
+  {
+    uint32 count = 0;
+    uint32 max   = 0; // CPU cycles
+    uint64_t sum = 0; // CPU cycles
+  };
+
+  struct Profile
+  {
+    ProfileStats stats[PROFILE::PROFILE_TYPES];
+    uint32 overBudget = 0; // number of ISR calls exceeding BUDGET_CYCLES
+    uint32 replyEntryCycles = 0; // clock ISR entry of last reply
+    uint32 replyStartCycles = 0; // start of last reply pulse
+    bool replyArmed = false;
+  };
+
+  static const uint32 BUDGET_CYCLES = F_CPU/100000; // CPU cycles per clock period (100 kHz)
+
+public:
+  void getProfile(Profile& profile);
+#endif
+
 private:
   class CYCLE
   {
   public:
-#if defined MODEL_SB_H20
-    static const unsigned int BUTTON_FRAMES = 7; // number of button frames in each cycle
-#elif defined MODEL_SJB_HS
-    static const unsigned int BUTTON_FRAMES = 9; // number of button frames in each cycle
-#endif
-    static const unsigned int TOTAL_FRAMES = 25 + BUTTON_FRAMES; // number of frames in each cycle
-    static const unsigned int DISPLAY_FRAME_GROUPS =  5; // number of digit frame groups in each cycle
-    static const unsigned int PERIOD = 21; // ms, period of frame cycle @todo might be longer for SJB-HS
+    // assumption (not yet verified by capture): all digit frame groups of a
+    // cycle are sent before its first button frame, the vote is done there
+    static const unsigned int DISPLAY_FRAME_GROUPS =  5; // max. number of digit frame groups in each cycle
+    static const unsigned int DISPLAY_MAJORITY = DISPLAY_FRAME_GROUPS/2 + 1; // min. number of matching groups to accept a value
+    static const unsigned int PERIOD = 21; // ms, nominal period of frame cycle, calibrated at runtime
+    static const unsigned int PERIOD_MIN = 10000; // µs, plausibility limit of calibration
+    static const unsigned int PERIOD_MAX = 50000; // µs, plausibility limit of calibration
+    static const unsigned int CALIBRATION_PERIOD = 2000; // ms
     static const unsigned int RECEIVE_TIMEOUT = 50*CYCLE::PERIOD; // ms
   };
 
@@ -212,22 +366,63 @@ private:
   {
   public  :
     static const unsigned int BITS = 16; // bits per frame
-    static const unsigned int FREQUENCY = CYCLE::TOTAL_FRAMES/CYCLE::PERIOD; // frames/ms
   };
 
   class BLINK
   {
   public:
     static const unsigned int PERIOD = 500; // ms, temp will blink 8 times in 4000 ms
-    static const unsigned int TEMP_FRAMES = PERIOD/4*FRAME::FREQUENCY; // sample duration of desired temp after blank display
-    static const unsigned int STOPPED_FRAMES = 2*PERIOD*FRAME::FREQUENCY; // must be longer than single blink duration
+    static const unsigned int TEMP_DURATION = PERIOD/4; // ms, sample duration of desired temp after blank display
+    static const unsigned int STOPPED_DURATION = 2*PERIOD; // ms, must be longer than single blink duration
+    static const unsigned int PHASE_MIN = PERIOD/4; // ms, min. duration of value phase of a valid blink
+    static const unsigned int PHASE_MAX = 3*PERIOD/4; // ms, max. duration of value phase of a valid blink
   };
 
   class CONFIRM_FRAMES
   {
   public:
-    static const unsigned int REGULAR = 3; // frames, for values which do not blink
-    static const unsigned int NOT_BLINKING = BLINK::PERIOD/2*FRAME::FREQUENCY/CYCLE::DISPLAY_FRAME_GROUPS; // frames, must be high enough to tell from blinking
+    static const unsigned int MIN = 2; // frames, for LED status on clean bus
+    static const unsigned int MAX = 6; // frames, for LED status on noisy bus
+  };
+
+  class CONFIRM_CYCLES
+  {
+  public:
+    static const unsigned int MIN = 1; // cycles, for values which do not blink on clean bus, each cycle is a majority vote of the digit groups
+    static const unsigned int MAX = 3; // cycles, for values which do not blink on noisy bus
+    static const unsigned int NOT_BLINKING = BLINK::PERIOD/2/CYCLE::PERIOD; // cycles, must be high enough to tell from blinking, recalculated with calibrated cycle period
+  };
+
+  class MODEL_DETECTION
+  {
+  public:
+    static const unsigned int CYCLES = 10; // consecutive cycles with same number of button frames
+    static const unsigned int TIMEOUT = 500; // ms, max. wait for detection during setup
+  };
+
+  class ERROR_RATE
+  {
+  public:
+    static const unsigned int PERIOD = 1000; // ms, error rate sample period
+    static const unsigned int CLEAN = 1000;  // ppm of frames, clean bus below
+    static const unsigned int NOISY = 10000; // ppm of frames, noisy bus above
+  };
+
+  class CAPTURE
+  {
+  public:
+    static const unsigned int MAX_FRAMES = 4096; // 16 kB, approx. 2.7 s
+    static const unsigned int POST_TRIGGER = 4;  // 1/4 of the ring is recorded after the trigger
+  };
+
+  class REPLY
+  {
+  public:
+    static const uint32 TICKS_PER_US = 80; // timer1 with TIM_DIV1 (80 MHz), independent of CPU clock
+    static const uint32 CYCLES_PER_TICK = F_CPU/80000000;
+    static const uint32 DELAY_TICKS = 2*TICKS_PER_US; // 2 µs after clock ISR entry
+    static const uint32 PULSE_TICKS = 3*TICKS_PER_US; // 3 µs
+    static const uint32 MIN_TICKS = TICKS_PER_US/2;   // if clock ISR exceeded the delay
   };
 
   class BUTTON
@@ -235,8 +430,14 @@ private:
   public:
     static const unsigned int PRESS_COUNT = BLINK::PERIOD/CYCLE::PERIOD; // cycles, must be long enough to activate buzzer
     static const unsigned int PRESS_SHORT_COUNT = 380/CYCLE::PERIOD; // cycles, must be long enough to trigger, but short enough to avoid double trigger
-    static const unsigned int ACK_CHECK_PERIOD = 10; // ms
     static const unsigned int ACK_TIMEOUT = 2*PRESS_COUNT*CYCLE::PERIOD; // ms
+    static const unsigned int CONFIRM_TIMEOUT = 2*CONFIRM_FRAMES::MAX*CYCLE::PERIOD; // ms, LED status confirmation of toggle after ack
+  };
+
+  class SCENE
+  {
+  public:
+    static const unsigned int CONFIRM_TIMEOUT = 2000; // ms, LED status confirmation of all toggled settings
   };
 
 private:
@@ -250,12 +451,35 @@ private:
     uint16 ledStatus        = UNDEF::USHORT;
 
     bool buzzer = false;
+    unsigned int buzzerAcks = 0; // buzzer off to on transitions
+    unsigned int ledChanges = 0; // confirmed LED status changes, buzzer excluded
     bool online = false;
     bool stateUpdated = false;
+    bool stateChanged = false;
+    bool desiredTempConfirmed = false;
 
     unsigned int lastErrorChangeFrameCounter = 0;
     unsigned int frameCounter = 0;
     unsigned int frameDropped = 0;
+    unsigned int displayGroupErrors = 0;  // digit groups outvoted by majority
+    unsigned int displayVoteFailures = 0; // cycles without majority
+    unsigned int invalidDigits = 0;       // unsupported segment patterns
+    unsigned int unsupportedFrames = 0;
+
+    unsigned int confirmCycles = CONFIRM_CYCLES::MAX; // adapted to error rate
+    unsigned int confirmFrames = CONFIRM_FRAMES::MAX; // adapted to error rate
+    unsigned int notBlinkingCycles = CONFIRM_CYCLES::NOT_BLINKING; // adapted to cycle period
+
+    MODEL detectedModel = MODEL::UNKNOWN;
+    unsigned int detectionFailures = 0; // stable number of button frames not matching any model
+
+    unsigned int cycleCounter = 0;
+
+    unsigned int clockEdges = 0;
+    unsigned int latchEdges = 0;     // clock edges with latch active
+    unsigned int completeFrames = 0;
+
+    bool wakeOnClock = false; // idle mode, wake up main loop on next clock edge
   };
 
   struct IsrState
@@ -268,24 +492,44 @@ private:
     uint16 frameValue = 0;
     uint16 receivedBits = 0;
 
-    unsigned int lastBlankDisplayFrameCounter = 0;
+    unsigned long cycleTime = 0; // ms, end of latest cycle
+    unsigned long lastBlankDisplayTime = 0; // ms
     unsigned int blankCounter = 0;
 
-    unsigned int stableDisplayValueCount      = CONFIRM_FRAMES::REGULAR;
-    unsigned int stableDisplayBlankCount      = CONFIRM_FRAMES::REGULAR;
-    unsigned int stableWaterTempCount         = CONFIRM_FRAMES::NOT_BLINKING;
+    unsigned int stableDisplayValueCount      = CONFIRM_CYCLES::MAX;
+    unsigned int stableDisplayBlankCount      = CONFIRM_CYCLES::MAX;
+    unsigned int stableWaterTempCount         = CONFIRM_CYCLES::NOT_BLINKING;
     unsigned int stableBlinkingWaterTempCount = 0;
-    unsigned int stableDisinfectionTimeCount  = CONFIRM_FRAMES::REGULAR;
-    unsigned int stableLedStatusCount         = CONFIRM_FRAMES::REGULAR;
+    unsigned int stableDisinfectionTimeCount  = CONFIRM_CYCLES::MAX;
+    unsigned int stableLedStatusCount         = CONFIRM_FRAMES::MAX;
 
     uint32 displayValue       = UNDEF::UINT;
     uint32 latestDisplayValue = UNDEF::UINT;
 
+    uint32 groupValues[CYCLE::DISPLAY_FRAME_GROUPS];
+    uint8 groupCount = 0;
     uint8 receivedDigits = 0;
 
+    uint8 buttonFrames = 0;
+    uint8 detectionButtonFrames = 0;
+    uint8 detectionCount = 0;
+    bool detectionFailed = false;
+
     bool isDisplayBlinking = false;
 
     bool reply = false;
+    bool replyPulse = false; // reply pulse in progress, ended by next timer interrupt
+  };
+
+  struct Capture
+  {
+    uint32* buffer = nullptr;      // ring, entries: frame value (low word), µs since previous entry (high word)
+    unsigned int size = 0;
+    unsigned int count = 0;        // recorded entries, max. size
+    unsigned int head = 0;         // index of next entry
+    unsigned int remaining = 0;    // entries until frozen, 0 = not triggered yet
+    bool frozen = false;
+    unsigned long lastTime = 0;
   };
 
   struct Buttons
@@ -300,28 +544,70 @@ private:
     unsigned int toggleTempDown     = 0;
   };
 
-private:
-  static const uint32 ERROR_NONE = 0;
+  struct PersistentState
+  {
+    uint32 crc              = 0;
+    uint32 waterTemp        = UNDEF::UINT;
+    uint32 desiredTemp      = UNDEF::UINT;
+    uint32 disinfectionTime = UNDEF::UINT;
+    uint32 error            = ERROR_NONE;
+    uint32 frameCounter     = 0;
+    uint16 ledStatus        = UNDEF::USHORT;
+    uint16 model            = MODEL::UNKNOWN;
+  };
 
 private:
   // ISR and ISR helper
-  static IRAM_ATTR void clockRisingISR(void* arg);
+  template<MODEL M> static IRAM_ATTR void clockRisingISR(void* arg);
   static IRAM_ATTR inline void decodeDisplay();
+  static IRAM_ATTR inline void voteDisplay();
+  static IRAM_ATTR inline void decodeDisplayValue();
   static IRAM_ATTR inline void decodeLED();
-  static IRAM_ATTR inline void decodeButton();
+  template<MODEL M> static IRAM_ATTR inline void decodeButton(uint32 startCycles);
+  static IRAM_ATTR void replyTimerISR();
+  static IRAM_ATTR inline void detectModel();
   static IRAM_ATTR inline void updateButtonState(volatile unsigned int& buttonPressCount);
+  static IRAM_ATTR inline void recordFrame();
+  static IRAM_ATTR inline void signalStateChange();
+  static IRAM_ATTR inline void markCommandStage(volatile uint32& stage);
+#ifdef ISR_PROFILING
+  template<MODEL M> static IRAM_ATTR inline void profileEdge(uint32 cycles, bool frameComplete);
+  static IRAM_ATTR inline void profileSample(unsigned int type, uint32 cycles);
+#endif
 
 private:
   // ISR variables
   static volatile State state;
   static volatile IsrState isrState;
   static volatile Buttons buttons;
+  static volatile Capture capture;
+  static volatile CommandTiming commandTiming;
+#ifdef ISR_PROFILING
+  static volatile Profile isrProfile;
+#endif
+
+private:
+  void restoreState();
+  void saveState();
+  int getConfirmedDesiredWaterTempCelsius() const;
+  uint32 persistentStateChecksum() const;
+  void adaptConfirmation(unsigned long now);
+  void calibrateCycle(unsigned long now);
 
 private:
   int convertDisplayToCelsius(uint32 value) const;
   bool waitBuzzerOff() const;
   bool pressButton(volatile unsigned int& buttonPressCount);
   bool changeWaterTemp(int up);
+  unsigned int planScene(const Scene& scene, SceneResult::Step* steps) const;
+  bool isSceneStepReached(const SceneResult::Step& step) const;
+  volatile unsigned int& getButton(uint8 setting);
+  void setToggle(bool on, uint8 (PureSpaIO::*isOn)() const, volatile unsigned int& button);
+  void setCommandActive(bool active);
+  void countRetry();
+  void countRepeat();
+  uint8 isLedOn(uint16 sbh20Mask, uint16 sjbhsMask) const;
+  void attachDecoder();
 
 private:
 #if defined MODEL_SB_H20
@@ -329,14 +615,64 @@ private:
 #elif defined MODEL_SJB_HS
   MODEL model = MODEL::SJBHS;
 #else
-  MODEL model;
-  #error no model (MODEL_SB_H20 or MODEL_SJB_HS) selected in common.h
+  MODEL model = MODEL::UNKNOWN; // detected at runtime
 #endif
 
+private:
+  // metrics
+  static Metrics::Counter framesTotal;
+  static Metrics::Counter framesDropped;
+  static Metrics::Counter buttonFailures;
+  static Metrics::Counter buttonRetries;
+  static Metrics::Counter buttonRepeats;
+  static Metrics::FixedHistogram<6> buttonDuration;
+  static Metrics::Counter displayGroupErrors;
+  static Metrics::Counter displayVoteFailures;
+  static Metrics::Counter invalidDigits;
+  static Metrics::Counter unsupportedFrames;
+  static Metrics::Gauge busErrorRate;
+  static Metrics::Gauge displayConfirmCycles;
+  static Metrics::Gauge ledConfirmFrames;
+  static Metrics::Gauge cyclePeriodGauge;
+  static Metrics::Gauge busHealthGauge;
+  static Metrics::Counter busLosses;
+  static Metrics::Counter captureFailures;
+  static Metrics::Counter detectionFailures;
+
 private:
   LANG language;
+  RadioPolicy* radioPolicy = nullptr;
   unsigned long lastStateUpdateTime = 0;
-  char errorBuffer[4];
+  unsigned long lastErrorRateTime = 0;
+  unsigned int lastErrorCount = 0;
+  unsigned int lastFrameCount = 0;
+  unsigned int errorRate = 0; // ppm of frames, smoothed
+  unsigned long lastCalibrationTime = 0;
+  unsigned int lastCycleCount = 0;
+  unsigned int cyclePeriod = 1000*CYCLE::PERIOD; // µs, smoothed
+  PersistentState persistentState;
+  bool stale = false;
+  bool captureFailed = false;
+  unsigned int lastCaptureErrorCount = 0;
+  unsigned int buttonPresses = 0;
+  CommandResult commandResult;
+  unsigned long commandResultTime = 0;
+  unsigned int commandResultPresses = 0;
+
+  struct BusCounters
+  {
+    unsigned int clockEdges = 0;
+    unsigned int latchEdges = 0;
+    unsigned int completeFrames = 0;
+    unsigned int decodeErrors = 0;
+  };
+
+  BusCounters lastBusCounters;
+  BUS_HEALTH busHealth = BUS_UNKNOWN;
+  unsigned long busSilentTime = 0;
+  bool idle = false;
+  bool idleLatchLevel = false; // latch level when idle mode was enabled
+  bool wakeupArmed = false;    // GPIO wake source enabled
 };
 
 #endif /* PURE_SPA_IO_H */
@@ -0,0 +1,254 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     RadioPolicy.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#include "RadioPolicy.h"
+
+#include <climits>
+
+
+namespace RADIO_METRIC
+{
+  const char SLEEP_MODE[]  PROGMEM = "wifi_sleep_mode";
+  const char TX_POWER[]    PROGMEM = "wifi_tx_power_qdbm";
+  const char NO_SLEEP[]    PROGMEM = "wifi_error_ppm_no_sleep";
+  const char LIGHT_SLEEP[] PROGMEM = "wifi_error_ppm_light_sleep";
+  const char MODEM_SLEEP[] PROGMEM = "wifi_error_ppm_modem_sleep";
+
+  const char* const MODE_NAMES[] = { "none", "light", "modem" };
+}
+
+Metrics::Gauge RadioPolicy::sleepModeGauge(RADIO_METRIC::SLEEP_MODE);
+Metrics::Gauge RadioPolicy::txPowerGauge(RADIO_METRIC::TX_POWER);
+Metrics::Gauge RadioPolicy::errorRateGauge[MODES] = {
+  { RADIO_METRIC::NO_SLEEP },
+  { RADIO_METRIC::LIGHT_SLEEP },
+  { RADIO_METRIC::MODEM_SLEEP }
+};
+
+/**
+ * select sleep mode for a button command in flight (blocking operation)
+ *
+ * @param active true at start of command, false at end of command
+ */
+void RadioPolicy::setCommandActive(bool active)
+{
+  commandActive = active;
+  apply();
+}
+
+/**
+ * @param idle true if the receiver is idle
+ */
+void RadioPolicy::setIdle(bool idle)
+{
+  this->idle = idle;
+  apply();
+}
+
+/**
+ * learn error rate of sleep mode and adapt TX power to RSSI
+ *
+ * @param errorRate [ppm] smoothed receive error rate
+ * @param receiving true if the receiver is decoding, false if it has no signal
+ */
+void RadioPolicy::loop(unsigned int errorRate, bool receiving)
+{
+  unsigned long now = millis();
+  if (now - sampleTime < SAMPLE_PERIOD)
+  {
+    return;
+  }
+  sampleTime = now;
+
+  // learn error rate of active sleep mode in normal operation
+  if (receiving && !commandActive && !idle)
+  {
+    if (settleSamples)
+    {
+      settleSamples--;
+    }
+    else
+    {
+      Mode& mode = modes[sleepMode];
+      mode.errorRate = mode.samples? (7*mode.errorRate + errorRate)/8 : errorRate;
+      mode.samples++;
+      errorRateGauge[sleepMode].set(mode.errorRate);
+    }
+  }
+
+  // explore the other sleep mode with the fewest samples periodically
+  if (exploring)
+  {
+    if (now - exploreTime >= EXPLORE_DURATION)
+    {
+      exploring = false;
+      exploreTime = now;
+    }
+  }
+  else if (receiving && !commandActive && !idle && now - exploreTime >= EXPLORE_PERIOD)
+  {
+    unsigned int samples = UINT_MAX;
+    for (unsigned int i=0; i<MODES; i++)
+    {
+      if (i != sleepMode && modes[i].samples < samples)
+      {
+        exploreMode = (WiFiSleepType_t)i;
+        samples = modes[i].samples;
+      }
+    }
+    exploring = true;
+    exploreTime = now;
+  }
+
+  // smoothed RSSI of connected station
+  int wifiRSSI = WiFi.RSSI();
+  if (wifiRSSI < 0)
+  {
+    rssi = rssi? (3*rssi + wifiRSSI)/4 : wifiRSSI;
+  }
+
+  apply();
+}
+
+WiFiSleepType_t RadioPolicy::getSleepMode() const
+{
+  return sleepMode;
+}
+
+/**
+ * print policy as JSON
+ *
+ * format: {"sleep":"<mode>","command":<bool>,"idle":<bool>,"explore":<bool>,"txPower":<dBm>,"rssi":<dBm>,"errorPpm":{"<mode>":[<ppm>,<samples>],...}}
+ *
+ * @param out
+ * @return number of bytes written
+ */
+size_t RadioPolicy::printPolicy(Print& out) const
+{
+  int txPower10 = 10*txPower/4;
+  size_t n = out.printf_P(PSTR("{\"sleep\":\"%s\",\"command\":%s,\"idle\":%s,\"explore\":%s,\"txPower\":%d.%d,\"rssi\":%d,\"errorPpm\":{"),
+                          RADIO_METRIC::MODE_NAMES[sleepMode], commandActive? "true" : "false", idle? "true" : "false",
+                          exploring? "true" : "false", txPower10/10, txPower10%10, rssi);
+  for (unsigned int i=0; i<MODES; i++)
+  {
+    n += out.printf_P(PSTR("%s\"%s\":[%u,%u]"), i? "," : "", RADIO_METRIC::MODE_NAMES[i], modes[i].errorRate, modes[i].samples);
+  }
+  n += out.print("}}");
+
+  return n;
+}
+
+/**
+ * apply selected sleep mode and TX power if changed
+ */
+void RadioPolicy::apply()
+{
+  WiFiSleepType_t mode = selectSleepMode();
+  if (mode != sleepMode)
+  {
+    // error rate needs time to follow mode change
+    sleepMode = mode;
+    settleSamples = SETTLE_SAMPLES;
+    sleepModeGauge.set(mode);
+  }
+  if (WiFi.getSleepMode() != mode)
+  {
+    WiFi.setSleepMode(mode);
+  }
+
+  int power = selectTxPower(rssi);
+  if (power != txPower)
+  {
+    txPower = power;
+    txPowerGauge.set(power);
+    WiFi.setOutputPower(power/4.0f);
+  }
+}
+
+/**
+ * @return sleep mode for current situation
+ */
+WiFiSleepType_t RadioPolicy::selectSleepMode() const
+{
+  if (commandActive)
+  {
+    return selectLowestErrorRate(WIFI_LIGHT_SLEEP);
+  }
+  else if (idle)
+  {
+    return WIFI_LIGHT_SLEEP;
+  }
+  else if (exploring)
+  {
+    return exploreMode;
+  }
+  else
+  {
+    return selectLowestErrorRate(WIFI_NONE_SLEEP);
+  }
+}
+
+/**
+ * @param preferred sleep mode
+ * @return sleep mode with lowest learned error rate, preferred mode if not clearly worse or not learned
+ */
+WiFiSleepType_t RadioPolicy::selectLowestErrorRate(WiFiSleepType_t preferred) const
+{
+  WiFiSleepType_t best = preferred;
+  for (unsigned int i=0; i<MODES; i++)
+  {
+    if (modes[i].samples && modes[best].samples && modes[i].errorRate + MARGIN < modes[best].errorRate)
+    {
+      best = (WiFiSleepType_t)i;
+    }
+  }
+  return best;
+}
+
+/**
+ * @param rssi [dBm] smoothed RSSI, 0 = unknown
+ * @return [1/4 dBm] TX power
+ */
+int RadioPolicy::selectTxPower(int rssi) const
+{
+  if (rssi == 0 || rssi < -70)
+  {
+    return 82; // 20.5 dBm max.
+  }
+  else if (rssi < -60)
+  {
+    return 68;
+  }
+  else if (rssi < -50)
+  {
+    return 56;
+  }
+  else
+  {
+    return 40;
+  }
+}
@@ -0,0 +1,104 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     RadioPolicy.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#ifndef RADIO_POLICY_H
+#define RADIO_POLICY_H
+
+#include <ESP8266WiFi.h>
+#include <Print.h>
+#include "Metrics.h"
+
+
+/**
+ * Central WiFi power policy coordinated with a timing critical receiver
+ *
+ * The sleep mode is selected by situation:
+ *
+ * COMMAND: sleep mode with the lowest learned receive error rate, light sleep
+ *          by default, while a button command is in flight
+ * IDLE:    light sleep while the receiver is idle
+ * NORMAL:  no sleep for lowest MQTT latency, unless another sleep mode has
+ *          shown a clearly lower receive error rate on this installation
+ *
+ * The receive error rate is learned per sleep mode from the samples taken
+ * in normal operation. Sleep modes without recent samples are explored
+ * for a short time periodically.
+ *
+ * The TX power is reduced with increasing RSSI to lower the RF coupling
+ * into the receiver and the current consumption.
+ */
+class RadioPolicy
+{
+public:
+  void setCommandActive(bool active);
+  void setIdle(bool idle);
+  void loop(unsigned int errorRate, bool receiving);
+
+  WiFiSleepType_t getSleepMode() const;
+  size_t printPolicy(Print& out) const;
+
+private:
+  static const unsigned int MODES = 3;                      // WiFiSleepType_t
+  static const unsigned long SAMPLE_PERIOD = 1000;          // [ms]
+  static const unsigned int SETTLE_SAMPLES = 4;             // samples discarded after mode change
+  static const unsigned long EXPLORE_PERIOD = 15*60000;     // [ms]
+  static const unsigned long EXPLORE_DURATION = 20000;      // [ms]
+  static const unsigned int MARGIN = 500;                   // [ppm] min. error rate improvement to leave no sleep
+
+private:
+  void apply();
+  WiFiSleepType_t selectSleepMode() const;
+  WiFiSleepType_t selectLowestErrorRate(WiFiSleepType_t preferred) const;
+  int selectTxPower(int rssi) const;
+
+private:
+  struct Mode
+  {
+    unsigned int errorRate = 0; // [ppm] smoothed
+    unsigned int samples = 0;
+  };
+
+  Mode modes[MODES];
+  WiFiSleepType_t sleepMode = WIFI_NONE_SLEEP;
+  WiFiSleepType_t exploreMode = WIFI_NONE_SLEEP;
+  int txPower = 0;            // [1/4 dBm]
+  int rssi = 0;               // [dBm]
+  bool commandActive = false;
+  bool idle = false;
+  bool exploring = false;
+  unsigned int settleSamples = SETTLE_SAMPLES;
+  unsigned long sampleTime = 0;
+  unsigned long exploreTime = 0;
+
+private:
+  // metrics
+  static Metrics::Gauge sleepModeGauge;
+  static Metrics::Gauge txPowerGauge;
+  static Metrics::Gauge errorRateGauge[MODES];
+};
+
+#endif /* RADIO_POLICY_H */
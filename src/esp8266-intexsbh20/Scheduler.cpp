@@ -0,0 +1,176 @@
+/*
+ * project:  generic
+ *
+ * file:     Scheduler.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#include "Scheduler.h"
+
+#include <coredecls.h>
+#include <stdexcept>
+
+
+/**
+ * register task
+ *
+ * @param name
+ * @param run
+ * @param period [ms] 0 = run in every loop pass
+ * @param event optional condition to run task before deadline
+ * @return task id
+ * @throws std::runtime_error if too many tasks are registered
+ */
+unsigned int Scheduler::add(const char* name, Function run, unsigned long period, Event event)
+{
+  if (taskCount >= MAX_TASKS)
+  {
+    throw std::runtime_error("too many scheduler tasks");
+  }
+
+  Task& task = tasks[taskCount];
+  task.name        = name;
+  task.run         = run;
+  task.event       = event;
+  task.period      = period;
+  task.lastRun     = millis() - period; // run immediately
+  taskCount++;
+  resetStats();
+
+  return taskCount - 1;
+}
+
+void Scheduler::setPeriod(unsigned int task, unsigned long period)
+{
+  tasks[task].period = period;
+}
+
+/**
+ * run due tasks and sleep until next deadline or event
+ */
+void Scheduler::loop()
+{
+  passes++;
+  unsigned long now = millis();
+  unsigned long sleep = MAX_SLEEP;
+  for (unsigned int i=0; i<taskCount; i++)
+  {
+    Task& task = tasks[i];
+    unsigned long elapsed = now - task.lastRun;
+    bool due = elapsed >= task.period;
+    if (due || (task.event && task.event()))
+    {
+      if (due)
+      {
+        unsigned long lateness = elapsed - task.period;
+        if (lateness > task.maxLateness)
+        {
+          task.maxLateness = lateness;
+        }
+        // keep period unless task is late by more than a period
+        task.lastRun = lateness < task.period? task.lastRun + task.period : now;
+      }
+
+      unsigned long start = micros();
+      task.run();
+      uint32 runTime = micros() - start;
+      task.runs++;
+      task.runTime += runTime;
+      if (runTime > task.maxRunTime)
+      {
+        task.maxRunTime = runTime;
+      }
+
+      now = millis();
+      elapsed = now - task.lastRun;
+    }
+
+    unsigned long remaining = elapsed < task.period? task.period - elapsed : 0;
+    if (remaining < sleep)
+    {
+      sleep = remaining;
+    }
+  }
+
+  // sleep until next deadline, wake up early if an event is signalled
+  if (sleep)
+  {
+    esp_delay(sleep, [this]() -> bool { return !isEventPending(); });
+  }
+  else
+  {
+    yield();
+  }
+}
+
+uint32 Scheduler::getPasses() const
+{
+  return passes;
+}
+
+bool Scheduler::isEventPending() const
+{
+  for (unsigned int i=0; i<taskCount; i++)
+  {
+    if (tasks[i].event && tasks[i].event())
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * print task statistics as JSON
+ *
+ * format: {"<task>":[<runs>,<avg run time µs>,<max run time µs>,<max lateness ms>],...}
+ *
+ * @param out
+ * @return number of bytes written
+ */
+size_t Scheduler::printStats(Print& out)
+{
+  size_t n = out.print('{');
+  for (unsigned int i=0; i<taskCount; i++)
+  {
+    const Task& task = tasks[i];
+    n += out.printf_P(PSTR("%s\"%s\":[%u,%u,%u,%u]"), i? "," : "", task.name,
+                      task.runs, task.runs? task.runTime/task.runs : 0, task.maxRunTime, task.maxLateness);
+  }
+  n += out.print('}');
+
+  return n;
+}
+
+void Scheduler::resetStats()
+{
+  for (unsigned int i=0; i<taskCount; i++)
+  {
+    Task& task = tasks[i];
+    task.runs        = 0;
+    task.runTime     = 0;
+    task.maxRunTime  = 0;
+    task.maxLateness = 0;
+  }
+}
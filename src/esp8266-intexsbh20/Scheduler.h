@@ -0,0 +1,90 @@
+/*
+ * project:  generic
+ *
+ * file:     Scheduler.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Print.h>
+
+
+/**
+ * Deadline based cooperative scheduler
+ *
+ * Each task is run periodically and/or when its event condition becomes true.
+ * Between the task runs the loop sleeps until the next deadline. An ISR can
+ * end the sleep early by setting the event condition of a task and calling
+ * esp_schedule().
+ *
+ * A task with period 0 runs in every loop pass and prevents sleeping.
+ *
+ * For each task the number of runs, the average and max. run time and the
+ * max. lateness relative to its deadline are recorded.
+ */
+class Scheduler
+{
+public:
+  typedef void (*Function)();
+  typedef bool (*Event)();
+
+public:
+  unsigned int add(const char* name, Function run, unsigned long period, Event event = nullptr);
+  void setPeriod(unsigned int task, unsigned long period);
+
+  void loop();
+  uint32 getPasses() const;
+
+  size_t printStats(Print& out);
+  void resetStats();
+
+public:
+  static const unsigned int MAX_TASKS = 8;
+  static const unsigned long MAX_SLEEP = 1000; // [ms]
+
+private:
+  struct Task
+  {
+    const char* name;
+    Function run;
+    Event event;
+    unsigned long period;     // [ms]
+    unsigned long lastRun;    // [ms] last deadline
+    uint32 runs;
+    uint32 runTime;           // [µs] sum since last reset
+    uint32 maxRunTime;        // [µs]
+    uint32 maxLateness;       // [ms]
+  };
+
+private:
+  bool isEventPending() const;
+
+private:
+  Task tasks[MAX_TASKS];
+  unsigned int taskCount = 0;
+  uint32 passes = 0; // loop passes, each after a sleep or yield
+};
+
+#endif /* SCHEDULER_H */
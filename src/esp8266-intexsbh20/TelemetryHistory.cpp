@@ -0,0 +1,407 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     TelemetryHistory.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#include "TelemetryHistory.h"
+
+#include <LittleFS.h>
+#include "MQTTClient.h"
+#include "common.h"
+
+
+namespace HISTORY_METRIC
+{
+  const char BYTES[] PROGMEM = "pool_history_bytes";
+  const char SPAN[]  PROGMEM = "pool_history_span_s";
+}
+
+namespace HISTORY
+{
+  const char FILENAME[] = "/history.bin";
+
+  // min. change of a channel to be recorded, suppresses flapping of the controller temperature
+  const sint16 DEADBAND[TelemetryHistory::CHANNELS] = { 1, 1, 1, 2 };
+}
+
+Metrics::Gauge TelemetryHistory::bytesGauge(HISTORY_METRIC::BYTES);
+Metrics::Gauge TelemetryHistory::spanGauge(HISTORY_METRIC::SPAN);
+
+/**
+ * append unsigned varint (7 bits per byte, LSB first)
+ *
+ * @return number of bytes written
+ */
+static unsigned int encodeVarint(uint8* buf, uint32 v)
+{
+  unsigned int n = 0;
+  while (v >= 0x80)
+  {
+    buf[n++] = (uint8)(v | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (uint8)v;
+  return n;
+}
+
+static uint32 decodeVarint(const uint8* buf, unsigned int& pos)
+{
+  uint32 v = 0;
+  unsigned int shift = 0;
+  uint8 b;
+  do
+  {
+    b = buf[pos++];
+    v |= (uint32)(b & 0x7F) << shift;
+    shift += 7;
+  } while ((b & 0x80) && shift < 35);
+  return v;
+}
+
+static inline uint32 zigzag(sint32 v)
+{
+  return ((uint32)v << 1) ^ (uint32)(v >> 31);
+}
+
+static inline sint32 unzigzag(uint32 v)
+{
+  return (sint32)(v >> 1) ^ -(sint32)(v & 1);
+}
+
+/**
+ * @param flushPeriod [ms] period of flushing the history to LittleFS, 0 = no flush and no restore
+ */
+void TelemetryHistory::setup(unsigned long flushPeriod)
+{
+  this->flushPeriod = flushPeriod;
+  memset(&data, 0, sizeof(data));
+  data.magic = MAGIC;
+  if (flushPeriod)
+  {
+    restore();
+  }
+  flushTime = millis();
+}
+
+/**
+ * restore history from LittleFS, the history time continues with the last sample
+ */
+void TelemetryHistory::restore()
+{
+  File file = LittleFS.open(HISTORY::FILENAME, "r");
+  if (file)
+  {
+    if (file.size() != sizeof(data) || file.read((uint8*)&data, sizeof(data)) != sizeof(data) || data.magic != MAGIC)
+    {
+      memset(&data, 0, sizeof(data));
+      data.magic = MAGIC;
+    }
+    file.close();
+  }
+}
+
+/**
+ * write history to LittleFS if flushing is enabled
+ */
+void TelemetryHistory::flush()
+{
+  if (flushPeriod)
+  {
+    File file = LittleFS.open(HISTORY::FILENAME, "w");
+    if (file)
+    {
+      file.write((const uint8*)&data, sizeof(data));
+      file.close();
+    }
+    flushTime = millis();
+  }
+}
+
+bool TelemetryHistory::isSampleDue() const
+{
+  return !sampled || timeDiff(millis(), sampleTime) >= SAMPLE_PERIOD;
+}
+
+/**
+ * add sample, a record is only written if a channel has changed by at least its deadband
+ *
+ * @param values channel values, UNDEF if unknown
+ */
+void TelemetryHistory::add(const sint16 values[CHANNELS])
+{
+  // advance history time by elapsed sample periods
+  unsigned long now = millis();
+  if (sampled)
+  {
+    unsigned long periods = timeDiff(now, sampleTime)/SAMPLE_PERIOD;
+    sampleTime += periods*SAMPLE_PERIOD;
+    data.time += periods;
+  }
+  else
+  {
+    sampled = true;
+    sampleTime = now;
+  }
+
+  if (!data.sequence)
+  {
+    startBlock(values);
+  }
+  else
+  {
+    // detect changed channels
+    uint32 mask = 0;
+    for (unsigned int i=0; i<CHANNELS; i++)
+    {
+      sint32 delta = (sint32)values[i] - data.values[i];
+      if (delta && (values[i] == UNDEF || data.values[i] == UNDEF || abs(delta) >= HISTORY::DEADBAND[i]))
+      {
+        mask |= 1 << i;
+      }
+    }
+
+    if (mask)
+    {
+      // encode record: elapsed periods and mask, then deltas of changed channels
+      uint8 record[RECORD_SIZE];
+      unsigned int n = encodeVarint(record, ((data.time - data.recordTime) << CHANNELS) | mask);
+      for (unsigned int i=0; i<CHANNELS; i++)
+      {
+        if (mask & (1 << i))
+        {
+          n += encodeVarint(record + n, zigzag((sint32)values[i] - data.values[i]));
+        }
+      }
+
+      unsigned int block = (data.sequence - 1) % BLOCKS;
+      if (data.length[block] + n > BLOCK_SIZE || (data.time - data.recordTime) >= (1UL << (32 - CHANNELS)))
+      {
+        startBlock(values);
+      }
+      else
+      {
+        memcpy(data.block[block] + data.length[block], record, n);
+        data.length[block] += n;
+        for (unsigned int i=0; i<CHANNELS; i++)
+        {
+          if (mask & (1 << i))
+          {
+            data.values[i] = values[i];
+          }
+        }
+        data.recordTime = data.time;
+      }
+    }
+  }
+
+  // update metrics
+  unsigned int blocks = data.sequence < BLOCKS? data.sequence : BLOCKS;
+  unsigned int bytes = 0;
+  for (unsigned int i=0; i<blocks; i++)
+  {
+    bytes += data.length[i];
+  }
+  bytesGauge.set(bytes);
+  spanGauge.set((data.time - data.start[(data.sequence - blocks) % BLOCKS])*(SAMPLE_PERIOD/1000));
+
+  if (flushPeriod && timeDiff(now, flushTime) >= flushPeriod)
+  {
+    flush();
+  }
+}
+
+/**
+ * start new block with keyframe, drops oldest block if ring is full
+ */
+void TelemetryHistory::startBlock(const sint16 values[CHANNELS])
+{
+  unsigned int block = data.sequence % BLOCKS;
+  data.sequence++;
+  data.start[block] = data.time;
+  data.length[block] = 0;
+  for (unsigned int i=0; i<CHANNELS; i++)
+  {
+    data.length[block] += encodeVarint(data.block[block] + data.length[block], zigzag(values[i]));
+    data.values[i] = values[i];
+  }
+  data.recordTime = data.time;
+}
+
+/**
+ * @return [sample periods] start of next block or end of history (exclusive)
+ */
+uint32 TelemetryHistory::getBlockEnd(uint32 sequence) const
+{
+  return (sequence + 1 < data.sequence)? data.start[(sequence + 1) % BLOCKS] : data.time + 1;
+}
+
+/**
+ * request history time range, published by subsequent calls of publish()
+ *
+ * @param payload "<from>[,<to>]" age [s] of start and end of range, from 0 = complete history
+ * @param length payload length
+ */
+void TelemetryHistory::request(const byte* payload, unsigned int length)
+{
+  char buf[24];
+  length = length < sizeof(buf) - 1? length : sizeof(buf) - 1;
+  memcpy(buf, payload, length);
+  buf[length] = '\0';
+
+  char* next;
+  uint32 periodSeconds = SAMPLE_PERIOD/1000;
+  uint32 from = strtoul(buf, &next, 10)/periodSeconds;
+  uint32 to = *next == ','? strtoul(next + 1, nullptr, 10)/periodSeconds : 0;
+
+  req.pending = true;
+  req.from = (from && from < data.time)? data.time - from : 0;
+  req.to = to < data.time? data.time - to : 0;
+  req.sequence = data.sequence > BLOCKS? data.sequence - BLOCKS : 0;
+  req.chunks = 0;
+  req.failed = false;
+}
+
+/**
+ * publish next block of requested range on topic 'pool/history/data' and
+ * a JSON summary on topic 'pool/history' after the last block or after
+ * a block could not be published
+ *
+ * summary: {"time":<s>,"from":<s>,"to":<s>,"chunks":<n>,"complete":true|false}
+ */
+void TelemetryHistory::publish(MQTTClient& mqttClient)
+{
+  if (!req.pending)
+  {
+    return;
+  }
+
+  // skip blocks outside of range, oldest blocks may have been dropped in the meantime
+  uint32 oldest = data.sequence > BLOCKS? data.sequence - BLOCKS : 0;
+  if (req.sequence < oldest)
+  {
+    req.sequence = oldest;
+  }
+  while (req.sequence < data.sequence && getBlockEnd(req.sequence) <= req.from)
+  {
+    req.sequence++;
+  }
+
+  if (!req.failed && req.sequence < data.sequence && data.start[req.sequence % BLOCKS] <= req.to)
+  {
+    uint32 sequence = req.sequence;
+    if (mqttClient.publish(MQTT_TOPIC::HISTORY_DATA, [this, sequence](Print& out) -> void { printBlock(out, sequence); }))
+    {
+      req.sequence++;
+      req.chunks++;
+    }
+    else
+    {
+      // publish truncated summary next
+      req.failed = true;
+    }
+  }
+  else
+  {
+    char buf[112];
+    uint32 periodSeconds = SAMPLE_PERIOD/1000;
+    snprintf_P(buf, sizeof(buf), PSTR("{\"time\":%u,\"from\":%u,\"to\":%u,\"chunks\":%u,\"complete\":%s}"),
+               data.time*periodSeconds, req.from*periodSeconds, req.to*periodSeconds, req.chunks, req.failed? "false" : "true");
+    mqttClient.publish(MQTT_TOPIC::HISTORY, buf, false, true);
+    req.pending = false;
+  }
+}
+
+/**
+ * decode block and print samples within requested range, the values at the
+ * start of the range are printed if the range starts within the block
+ */
+size_t TelemetryHistory::printBlock(Print& out, uint32 sequence) const
+{
+  unsigned int block = sequence % BLOCKS;
+  const uint8* buf = data.block[block];
+  unsigned int pos = 0;
+  size_t n = 0;
+
+  // keyframe
+  sint16 values[CHANNELS];
+  for (unsigned int i=0; i<CHANNELS; i++)
+  {
+    values[i] = unzigzag(decodeVarint(buf, pos));
+  }
+  uint32 time = data.start[block];
+  bool pending = time < req.from;
+  if (!pending && time <= req.to)
+  {
+    n += printSample(out, time, values);
+  }
+
+  // records
+  while (pos < data.length[block] && time <= req.to)
+  {
+    uint32 head = decodeVarint(buf, pos);
+    time += head >> CHANNELS;
+    if (pending && time > req.from)
+    {
+      n += printSample(out, req.from, values);
+      pending = false;
+    }
+    for (unsigned int i=0; i<CHANNELS; i++)
+    {
+      if (head & (1 << i))
+      {
+        values[i] += unzigzag(decodeVarint(buf, pos));
+      }
+    }
+    if (time >= req.from)
+    {
+      pending = false;
+      if (time <= req.to)
+      {
+        n += printSample(out, time, values);
+      }
+    }
+  }
+
+  if (pending && getBlockEnd(sequence) > req.from)
+  {
+    n += printSample(out, req.from, values);
+  }
+
+  return n;
+}
+
+/**
+ * print CSV line "<time [s]>,<value>,...", empty value if undefined
+ */
+size_t TelemetryHistory::printSample(Print& out, uint32 time, const sint16 values[CHANNELS]) const
+{
+  size_t n = out.printf_P(PSTR("%u"), time*(SAMPLE_PERIOD/1000));
+  for (unsigned int i=0; i<CHANNELS; i++)
+  {
+    n += values[i] == UNDEF? out.print(',') : out.printf_P(PSTR(",%d"), values[i]);
+  }
+  n += out.print('\n');
+  return n;
+}
@@ -0,0 +1,131 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     TelemetryHistory.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+
+#ifndef TELEMETRY_HISTORY_H
+#define TELEMETRY_HISTORY_H
+
+#include <c_types.h>
+#include <climits>
+#include <Print.h>
+#include "Metrics.h"
+
+class MQTTClient;
+
+
+/**
+ * fixed size ring buffer with the history of the pool telemetry, sampled
+ * once per minute
+ *
+ * The ring consists of blocks, each starting with a keyframe of all channel
+ * values followed by change records. A record is only written if at least
+ * one channel has changed and contains the elapsed sample periods and the
+ * changed channel mask as varint and the channel deltas as zigzag varints.
+ * When the ring is full the oldest block is dropped. The ring can be
+ * flushed to LittleFS periodically and is restored at startup, but the
+ * history time does not advance while the controller is off.
+ *
+ * A time range can be requested and is published as CSV in chunks of one
+ * block per call of publish(), each line with the history time [s] and the
+ * channel values, an empty value if undefined.
+ */
+class TelemetryHistory
+{
+public:
+  enum CHANNEL
+  {
+    WATER_ACT = 0,   // [°C]
+    WATER_SET,       // [°C]
+    LED,             // bitfield
+    CONTROLLER_TEMP, // [°C]
+    CHANNELS
+  };
+
+  static const sint16 UNDEF = SHRT_MIN;
+
+public:
+  void setup(unsigned long flushPeriod);
+  bool isSampleDue() const;
+  void add(const sint16 values[CHANNELS]);
+  void flush();
+
+  void request(const byte* payload, unsigned int length);
+  void publish(MQTTClient& mqttClient);
+
+private:
+  static const unsigned long SAMPLE_PERIOD = 60000; // [ms]
+  static const unsigned int BLOCKS = 12;
+  static const unsigned int BLOCK_SIZE = 256;       // [bytes]
+  static const unsigned int RECORD_SIZE = 5 + CHANNELS*3; // [bytes] max. size of keyframe or record
+  static const uint32 MAGIC = 0x31545348;           // "HST1"
+
+private:
+  void restore();
+  void startBlock(const sint16 values[CHANNELS]);
+  uint32 getBlockEnd(uint32 sequence) const;
+  size_t printBlock(Print& out, uint32 sequence) const;
+  size_t printSample(Print& out, uint32 time, const sint16 values[CHANNELS]) const;
+
+private:
+  // persisted state
+  struct Data
+  {
+    uint32 magic;
+    uint32 time;                     // [sample periods] of last sample
+    uint32 recordTime;               // [sample periods] of last record
+    uint32 sequence;                 // number of blocks started
+    sint16 values[CHANNELS];         // last recorded values
+    uint32 start[BLOCKS];            // [sample periods] of keyframe
+    uint16 length[BLOCKS];           // [bytes]
+    uint8  block[BLOCKS][BLOCK_SIZE];
+  };
+
+  Data data;
+  unsigned long flushPeriod = 0;     // [ms], 0 = no flush
+  unsigned long flushTime = 0;
+  unsigned long sampleTime = 0;
+  bool sampled = false;
+
+  // pending request
+  struct Request
+  {
+    bool pending = false;
+    uint32 from = 0;                 // [sample periods]
+    uint32 to = 0;                   // [sample periods]
+    uint32 sequence = 0;             // next block to publish
+    unsigned int chunks = 0;
+    bool failed = false;             // chunk not published, range truncated
+  };
+
+  Request req;
+
+private:
+  // metrics
+  static Metrics::Gauge bytesGauge;
+  static Metrics::Gauge spanGauge;
+};
+
+#endif /* TELEMETRY_HISTORY_H */
@@ -0,0 +1,133 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     WiFiBootCache.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "WiFiBootCache.h"
+
+#include <coredecls.h>
+#include "common.h"
+
+
+/**
+ * start WiFi connect, try cached BSSID and channel first
+ *
+ * @param ssid
+ * @param passphrase
+ */
+void WiFiBootCache::begin(const char* ssid, const char* passphrase)
+{
+  this->ssid = ssid;
+  this->passphrase = passphrase;
+  beginTime = millis();
+
+  if (restore())
+  {
+    // fast connect: skip channel scan, keep DHCP
+    Serial.printf_P(PSTR("WiFi fast connect (channel %u)\n"), data.channel);
+    WiFi.begin(ssid, passphrase, data.channel, data.bssid);
+    fastConnecting = true;
+  }
+  else
+  {
+    WiFi.begin(ssid, passphrase);
+  }
+}
+
+/**
+ * update cache after connect and fall back to regular connect if fast connect fails
+ *
+ * @param wifiStatus
+ */
+void WiFiBootCache::loop(wl_status_t wifiStatus)
+{
+  if (wifiStatus == WL_CONNECTED)
+  {
+    if (fastConnecting)
+    {
+      fastConnecting = false;
+      fastConnected = true;
+    }
+    if (!saved)
+    {
+      save();
+      saved = true;
+    }
+  }
+  else
+  {
+    saved = false;
+    if (fastConnecting && timeDiff(millis(), beginTime) > CONFIG::WIFI_FAST_CONNECT_TIMEOUT)
+    {
+      // fast connect failed, retry with channel scan
+      Serial.println(F("WiFi fast connect failed"));
+      fastConnecting = false;
+      invalidate();
+      WiFi.disconnect();
+      WiFi.begin(ssid, passphrase);
+    }
+  }
+}
+
+/**
+ * @return true if the WiFi connection was established using the cache
+ */
+bool WiFiBootCache::isFastConnect() const
+{
+  return fastConnected;
+}
+
+uint32 WiFiBootCache::checksum() const
+{
+  return crc32((const uint8*)&data + sizeof(data.crc), sizeof(data) - sizeof(data.crc));
+}
+
+/**
+ * read cache from RTC memory
+ *
+ * @return true if cache is valid
+ */
+bool WiFiBootCache::restore()
+{
+  return ESP.rtcUserMemoryRead(RTC_BLOCK::WIFI_CACHE, (uint32*)&data, sizeof(data))
+         && data.crc == checksum() && data.channel;
+}
+
+/**
+ * write parameters of current WiFi connection to RTC memory
+ */
+void WiFiBootCache::save()
+{
+  memcpy(data.bssid, WiFi.BSSID(), sizeof(data.bssid));
+  data.channel  = WiFi.channel();
+  data.reserved = 0;
+  data.crc      = checksum();
+  ESP.rtcUserMemoryWrite(RTC_BLOCK::WIFI_CACHE, (uint32*)&data, sizeof(data));
+}
+
+void WiFiBootCache::invalidate()
+{
+  memset(&data, 0, sizeof(data));
+  ESP.rtcUserMemoryWrite(RTC_BLOCK::WIFI_CACHE, (uint32*)&data, sizeof(data));
+}
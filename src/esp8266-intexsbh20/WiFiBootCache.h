@@ -0,0 +1,76 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     WiFiBootCache.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef WIFI_BOOT_CACHE_H
+#define WIFI_BOOT_CACHE_H
+
+#include <ESP8266WiFi.h>
+
+
+/**
+ * Caches BSSID and channel of the last successful WiFi connection in RTC
+ * user memory. The cache survives restarts and resets but not a power cycle.
+ *
+ * If the cache is valid the next connect skips the channel scan. DHCP is
+ * always used, so the lease is renewed and the address cannot be handed to
+ * another host after the lease expired. If the fast connect does not succeed
+ * within a timeout the cache is invalidated and a regular connect with
+ * channel scan is started.
+ */
+class WiFiBootCache
+{
+public:
+  void begin(const char* ssid, const char* passphrase);
+  void loop(wl_status_t wifiStatus);
+
+  bool isFastConnect() const;
+
+private:
+  struct Data
+  {
+    uint32 crc;
+    uint8  bssid[6];
+    uint8  channel;
+    uint8  reserved;
+  };
+
+private:
+  bool restore();
+  void save();
+  void invalidate();
+  uint32 checksum() const;
+
+private:
+  Data data;
+  const char* ssid = nullptr;
+  const char* passphrase = nullptr;
+  unsigned long beginTime = 0;
+  bool fastConnecting = false;
+  bool fastConnected = false;
+  bool saved = false;
+};
+
+#endif /* WIFI_BOOT_CACHE_H */
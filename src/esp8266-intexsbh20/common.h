@@ -37,7 +37,8 @@
 
  *****************************************************************************/
 
-// select Intex PureSpa model by commenting in the desired variant
+// the Intex PureSpa model is detected at runtime, optionally it can be fixed
+// by commenting in the desired variant (saves IRAM of the unused decoders)
 // A) PureSpa SB-H20, PureSpa SSP-H-20-1 and SimpleSpa SB–B20
 //#define MODEL_SB_H20
 // B) PureSpa SJB-HS
@@ -53,6 +54,10 @@
 
 //#define SERIAL_DEBUG
 
+// measure the CPU cycles spent in the clock ISR per frame type and publish the
+// statistics via MQTT, adds a few cycles to each ISR call
+//#define ISR_PROFILING
+
 /*****************************************************************************/
 
 namespace CONFIG
@@ -61,11 +66,23 @@ namespace CONFIG
 
   // WiFi parameters
   const unsigned long WIFI_MAX_DISCONNECT_DURATION = 900000; // [ms] 5 min until reboot
+  const unsigned long WIFI_FAST_CONNECT_TIMEOUT    =   5000; // [ms] until falling back to full scan and DHCP
 
   // MQTT publish rates
   const unsigned int  POOL_UPDATE_PERIOD           =    500; // [ms]
   const unsigned int  WIFI_UPDATE_PERIOD           =  30000; // [ms] 30 sec
   const unsigned int  FORCED_STATE_UPDATE_PERIOD   =  10000; // [ms] 10 sec
+
+  // scheduler
+  const unsigned long TASK_PERIOD                  =    100; // [ms] default period of loop tasks
+
+  // low power idle mode
+  const unsigned long IDLE_DELAY                   =  60000; // [ms] bus silence until idle mode, config file: idleDelay [s], 0 = disabled
+  const unsigned long IDLE_TASK_PERIOD             =   1000; // [ms] period of loop tasks in idle mode
+  const unsigned long IDLE_HEARTBEAT_PERIOD        =  60000; // [ms] forced state update in idle mode
+
+  // telemetry history
+  const unsigned long HISTORY_FLUSH_PERIOD         =      0; // [ms] flush to LittleFS, config file: historyFlush [min], 0 = disabled
 }
 
 // Config File Tags
@@ -83,6 +100,9 @@ namespace CONFIG_TAG
   const char MQTT_PASSWORD[]   = "mqttPassword";
   const char MQTT_RETAIN[]     = "mqttRetain";
   const char MQTT_ERROR_LANG[] = "errorLanguage";
+  const char MQTT_OTA[]        = "mqttUpdate";
+  const char IDLE_DELAY[]      = "idleDelay";
+  const char HISTORY_FLUSH[]   = "historyFlush";
 };
 
 // MQTT topics
@@ -90,13 +110,18 @@ namespace MQTT_TOPIC
 {
   // publish
   const char BUBBLE[]       = "pool/bubble";
+  const char BUS[]          = "pool/bus";
   const char DISINFECTION[] = "pool/disinfection"; // SJB-HS only
   const char ERROR[]        = "pool/error";
   const char FILTER[]       = "pool/filter";
   const char HEATER[]       = "pool/heater";
+  const char HISTORY[]      = "pool/history";
+  const char HISTORY_DATA[] = "pool/history/data";
   const char JET[]          = "pool/jet"; // SJB-HS only
   const char MODEL[]        = "pool/model";
   const char POWER[]        = "pool/power";
+  const char RESULT[]       = "pool/command/result";
+  const char SCENE[]        = "pool/scene";
   const char WATER_ACT[]    = "pool/water/tempAct";
   const char WATER_SET[]    = "pool/water/tempSet";
   const char VERSION[]      = "wifi/version";
@@ -105,16 +130,43 @@ namespace MQTT_TOPIC
   const char WIFI_TEMP[]    = "wifi/temp";
   const char STATE[]        = "wifi/state";
   const char OTA[]          = "wifi/update";
+  const char OTA_OFFSET[]   = "wifi/update/offset";
+  const char BOOT[]         = "wifi/boot";
+  const char CAPTURE[]      = "wifi/capture";
+  const char CAPTURE_DATA[] = "wifi/capture/data";
+  const char ISR_PROFILE[]  = "wifi/isr";
+  const char METRICS[]      = "wifi/metrics";
+  const char METRICS_TEXT[] = "wifi/metrics/prometheus";
+  const char TASKS[]        = "wifi/tasks";
+  const char LATENCY[]      = "wifi/latency";
+  const char RADIO[]        = "wifi/radio";
 
   // subscribe
   const char CMD_BUBBLE[]       = "pool/command/bubble";
   const char CMD_DISINFECTION[] = "pool/command/disinfection"; // SJB-HS only
   const char CMD_FILTER[]       = "pool/command/filter";
   const char CMD_HEATER[]       = "pool/command/heater";
+  const char CMD_HISTORY[]      = "pool/command/history";
   const char CMD_JET[]          = "pool/command/jet"; // SJB-HS only
   const char CMD_POWER[]        = "pool/command/power";
+  const char CMD_SCENE[]        = "pool/command/scene";
   const char CMD_WATER[]        = "pool/command/water/tempSet";
   const char CMD_OTA[]          = "wifi/command/update";
+  const char CMD_OTA_BEGIN[]    = "wifi/command/update/begin";
+  const char CMD_OTA_CHUNK[]    = "wifi/command/update/chunk";
+  const char CMD_CAPTURE[]      = "wifi/command/capture";
+  const char CMD_CAPTURE_RING[] = "wifi/command/capture/ring";
+  const char CMD_CAPTURE_TRIG[] = "wifi/command/capture/trigger";
+  const char CMD_METRICS[]      = "wifi/command/metrics";
+  const char CMD_HEAP_ASSERT[]  = "wifi/command/heapAssert";
+}
+
+// RTC user memory layout (offsets in 4 byte blocks, 128 blocks available)
+namespace RTC_BLOCK
+{
+  // blocks 0..31 are reserved for the eboot command of the OTA update
+  const uint32 WIFI_CACHE = 32; // 8 blocks
+  const uint32 SPA_STATE  = 40; // 8 blocks
 }
 
 // Languages
@@ -39,7 +39,7 @@
  *
  * Board: Wemos D1 mini (ESP8266)
  *
- * CPU:        160 MHz
+ * CPU:        160 MHz (80 MHz possible)
  * Flash:      4M (FS: 1M, OTA: 1M)
  * Debug:      disabled
  * IwIP:       v2 lower memory
@@ -49,19 +49,33 @@
  */
 
 #include "common.h"
+#include "BootTimeline.h"
+#include "CommandLatency.h"
 #include "ConfigurationFile.h"
+#include "HeapTracker.h"
 #include "MQTTClient.h"
 #include "MQTTPublisher.h"
 #include "NTCThermometer.h"
 #include "OTAUpdate.h"
 #include "PureSpaIO.h"
+#include "RadioPolicy.h"
+#include "Scheduler.h"
+#include "TelemetryHistory.h"
+#include "WiFiBootCache.h"
 
 #include <stdexcept>
+#include <ArduinoJson.h>
 
+BootTimeline bootTimeline;
+CommandLatency commandLatency;
 ConfigurationFile config;
 NTCThermometer thermometer;
 OTAUpdate otaUpdate;
 PureSpaIO pureSpaIO;
+RadioPolicy radioPolicy;
+Scheduler scheduler;
+TelemetryHistory history;
+WiFiBootCache wifiBootCache;
 
 MQTTClient mqttClient;
 MQTTPublisher mqttPublisher(mqttClient, pureSpaIO, thermometer);
@@ -72,8 +86,320 @@ String mqttPort;
 unsigned long disconnectTime = 0;
 LANG language = LANG::CODE;
 bool initialized = false;
+bool online = false;
+unsigned int poolTaskId = 0;
+unsigned int busTaskId = 0;
+unsigned int wifiTaskId = 0;
+unsigned int mqttTaskId = 0;
+unsigned int publishTaskId = 0;
+unsigned int otaTaskId = 0;
+unsigned int idleTaskId = 0;
+unsigned long idleDelay = CONFIG::IDLE_DELAY;
+unsigned long historyFlushPeriod = CONFIG::HISTORY_FLUSH_PERIOD;
+bool idle = false;
+PureSpaIO::MODEL registeredModel = PureSpaIO::MODEL::UNKNOWN;
 
 
+/**
+ * start latency measurement of command received via MQTT
+ */
+void beginCommand(CommandLatency::COMMAND command)
+{
+  commandLatency.begin(command, mqttClient.getReceiveTime(), pureSpaIO);
+}
+
+/**
+ * publish result of command received via MQTT
+ */
+void endCommand()
+{
+  commandLatency.publishResult(pureSpaIO, mqttClient);
+}
+
+/**
+ * apply scene received via MQTT and publish result
+ *
+ * @param payload JSON {"power":<bool>,"heater":<bool>,"filter":<bool>,"bubble":<bool>,"jet":<bool>,"disinfection":<h>,"water":<°C>}, all optional
+ * @param length payload length
+ */
+void sceneCommand(const byte* payload, unsigned int length)
+{
+  // parse payload before publishing, publishing will overwrite payload
+  PureSpaIO::Scene scene;
+  StaticJsonDocument<192> doc;
+  if (!deserializeJson(doc, payload, length))
+  {
+    for (unsigned int i=0; i<PureSpaIO::Scene::SETTINGS; i++)
+    {
+      const char* key = PureSpaIO::getSceneSettingName(i);
+      if (!doc[key].isNull())
+      {
+        scene.target[i] = doc[key].as<int>();
+      }
+    }
+  }
+
+  beginCommand(CommandLatency::COMMAND::SCENE);
+  PureSpaIO::SceneResult result;
+  pureSpaIO.setScene(scene, result);
+  mqttClient.publish(MQTT_TOPIC::SCENE, [&result](Print& out) -> void { pureSpaIO.printSceneResult(out, result); });
+  endCommand();
+}
+
+/**
+ * register model specific MQTT metadata, client ID and subscribers,
+ * repeated when the model is detected after setup
+ */
+void setupModelSpecific()
+{
+  registeredModel = pureSpaIO.getModel();
+  if (registeredModel != PureSpaIO::MODEL::UNKNOWN)
+  {
+    Serial.printf_P(PSTR("model %s\n"), pureSpaIO.getModelName());
+  }
+
+  mqttClient.addMetadata(MQTT_TOPIC::MODEL, pureSpaIO.getModelName());
+  mqttClient.setClientId(pureSpaIO.getModelName());
+  if (registeredModel == PureSpaIO::MODEL::SJBHS)
+  {
+    mqttClient.addSubscriber(MQTT_TOPIC::CMD_DISINFECTION, [](int i) -> void  { beginCommand(CommandLatency::COMMAND::DISINFECTION); pureSpaIO.setDisinfectionTime(i); endCommand(); });
+    mqttClient.addSubscriber(MQTT_TOPIC::CMD_JET,          [](bool b) -> void { beginCommand(CommandLatency::COMMAND::JET);          pureSpaIO.setJetOn(b); endCommand(); });
+  }
+}
+
+/**
+ * add pool telemetry to history, LED bitfield: power, filter, heater, heater standby,
+ * bubble, jet, disinfection (bit 0..6)
+ */
+void sampleHistory()
+{
+  sint16 values[TelemetryHistory::CHANNELS];
+
+  int waterAct = pureSpaIO.getActWaterTempCelsius();
+  int waterSet = pureSpaIO.getDesiredWaterTempCelsius();
+  values[TelemetryHistory::WATER_ACT] = waterAct == PureSpaIO::UNDEF::INT? TelemetryHistory::UNDEF : waterAct;
+  values[TelemetryHistory::WATER_SET] = waterSet == PureSpaIO::UNDEF::INT? TelemetryHistory::UNDEF : waterSet;
+
+  if (pureSpaIO.isPowerOn() == PureSpaIO::UNDEF::BOOL)
+  {
+    values[TelemetryHistory::LED] = TelemetryHistory::UNDEF;
+  }
+  else
+  {
+    const uint8 leds[] = { pureSpaIO.isPowerOn(), pureSpaIO.isFilterOn(), pureSpaIO.isHeaterOn(), pureSpaIO.isHeaterStandby(),
+                           pureSpaIO.isBubbleOn(), pureSpaIO.isJetOn(), pureSpaIO.isDisinfectionOn() };
+    sint16 bits = 0;
+    for (unsigned int i=0; i<sizeof(leds); i++)
+    {
+      bits |= (leds[i] == 1) << i;
+    }
+    values[TelemetryHistory::LED] = bits;
+  }
+
+  float t = thermometer.getTemperature();
+  values[TelemetryHistory::CONTROLLER_TEMP] = (t >= -60 && t <= 145)? (sint16)lroundf(t) : TelemetryHistory::UNDEF;
+
+  history.add(values);
+}
+
+/**
+ * scheduler task: check bus signals
+ */
+void busTask()
+{
+  pureSpaIO.checkBusHealth();
+}
+
+/**
+ * scheduler task: decode pool state
+ */
+void poolTask()
+{
+  {
+    HeapTracker::Scope scope(HeapTracker::TAG::PURE_SPA_IO);
+    pureSpaIO.loop();
+  }
+  if (pureSpaIO.getModel() != registeredModel)
+  {
+    setupModelSpecific();
+  }
+  if (pureSpaIO.getTotalFrames())
+  {
+    bootTimeline.mark(BootTimeline::PHASE::FIRST_FRAME);
+  }
+  if (pureSpaIO.isStateComplete())
+  {
+    bootTimeline.mark(BootTimeline::PHASE::STATE_COMPLETE);
+  }
+  if (history.isSampleDue())
+  {
+    sampleHistory();
+  }
+}
+
+/**
+ * scheduler task: monitor WiFi connection
+ */
+void wifiTask()
+{
+  wl_status_t wifiStatus = WiFi.status(); //  WL_IDLE_STATUS 0, WL_NO_SSID_AVAIL 1, WL_SCAN_COMPLETED 2, WL_CONNECTED 3, WL_CONNECT_FAILED 4, WL_CONNECTION_LOST 5, WL_DISCONNECTED 6, WL_NO_SHIELD 255
+  unsigned long now = millis();
+  wifiBootCache.loop(wifiStatus);
+
+  if (wifiStatus == WL_CONNECTED)
+  {
+    // WiFi is connected
+    disconnectTime = 0;
+
+    if (!initialized)
+    {
+      bootTimeline.mark(BootTimeline::PHASE::WIFI_CONNECTED);
+      bootTimeline.setFastConnect(wifiBootCache.isFastConnect());
+
+      // publish client IP address
+      mqttClient.addMetadata(MQTT_TOPIC::IP, WiFi.localIP().toString().c_str());
+      initialized = true;
+    }
+    else
+    {
+      online = true;
+    }
+
+    // adapt WiFi sleep mode and TX power
+    radioPolicy.loop(pureSpaIO.getErrorRate(), pureSpaIO.getBusHealth() == PureSpaIO::BUS_OK);
+  }
+  else
+  {
+    online = false;
+
+    // restart ESP8266 if WiFi connection cannot be established
+    if (!disconnectTime)
+    {
+      // WiFi disconnected
+      disconnectTime = now;
+    }
+    else if (timeDiff(now, disconnectTime) > CONFIG::WIFI_MAX_DISCONNECT_DURATION)
+    {
+      // WiFi disconnected too long, restart ESP
+      DEBUG_MSG("restarting ... (no WiFi connection for several minutes)\n");
+      ESP.restart();
+    }
+  }
+}
+
+/**
+ * scheduler task: connect to MQTT server and receive commands
+ */
+void mqttTask()
+{
+  if (online)
+  {
+    HeapTracker::Scope scope(HeapTracker::TAG::MQTT_CLIENT);
+    mqttClient.loop();
+    if (mqttClient.isConnected())
+    {
+      bootTimeline.mark(BootTimeline::PHASE::MQTT_CONNECTED);
+    }
+  }
+}
+
+/**
+ * scheduler task: publish pool state, also triggered by change of pool state
+ */
+void publishTask()
+{
+  if (online)
+  {
+    HeapTracker::Scope scope(HeapTracker::TAG::MQTT_PUBLISHER);
+    mqttPublisher.loop();
+
+    // measure command latency
+    commandLatency.loop(mqttPublisher.getPoolPublishTime(), pureSpaIO, mqttClient);
+
+    // report boot phases
+    if (mqttPublisher.isPoolPublished())
+    {
+      bootTimeline.mark(BootTimeline::PHASE::FIRST_PUBLISH);
+    }
+    bootTimeline.publish(mqttClient);
+
+    // stream requested history, one chunk per call
+    history.publish(mqttClient);
+  }
+}
+
+/**
+ * scheduler task: OTA update, no idle while receiving update stream
+ */
+void otaTask()
+{
+  if (online)
+  {
+    HeapTracker::Scope scope(HeapTracker::TAG::OTA_UPDATE);
+    otaUpdate.loop(mqttClient);
+  }
+  unsigned long period = otaUpdate.isStreaming()? 0 : (idle? CONFIG::IDLE_TASK_PERIOD : CONFIG::TASK_PERIOD);
+  scheduler.setPeriod(mqttTaskId, period);
+  scheduler.setPeriod(otaTaskId, period);
+}
+
+/**
+ * enter or leave low power idle mode: slow down loop tasks, allow light
+ * sleep and wake up on bus activity
+ */
+void setIdle(bool enable)
+{
+  idle = enable;
+  pureSpaIO.setIdle(enable);
+  mqttPublisher.setIdle(enable);
+
+  unsigned long period = enable? CONFIG::IDLE_TASK_PERIOD : CONFIG::TASK_PERIOD;
+  scheduler.setPeriod(poolTaskId, period);
+  scheduler.setPeriod(busTaskId, enable? CONFIG::IDLE_TASK_PERIOD : PureSpaIO::BUS_CHECK::PERIOD);
+  scheduler.setPeriod(wifiTaskId, period);
+  scheduler.setPeriod(mqttTaskId, period);
+  scheduler.setPeriod(publishTaskId, period);
+  scheduler.setPeriod(otaTaskId, period);
+  scheduler.setPeriod(idleTaskId, period);
+
+  radioPolicy.setIdle(enable);
+}
+
+/**
+ * scheduler task: enter idle mode when the bus is silent, also triggered
+ * by the first clock edge in idle mode
+ */
+void idleTask()
+{
+  if (idle)
+  {
+    if (pureSpaIO.isWakeupPending())
+    {
+      setIdle(false);
+    }
+  }
+  else if (idleDelay && pureSpaIO.isBusSilent(idleDelay) && !otaUpdate.isStreaming())
+  {
+    setIdle(true);
+  }
+}
+
+/**
+ * scheduler task: publish task statistics
+ */
+void statsTask()
+{
+  mqttPublisher.updateWakeups(scheduler.getPasses());
+  if (online && mqttClient.publish(MQTT_TOPIC::TASKS, [](Print& out) -> void { scheduler.printStats(out); }))
+  {
+    scheduler.resetStats();
+  }
+  if (online)
+  {
+    mqttClient.publish(MQTT_TOPIC::RADIO, [](Print& out) -> void { radioPolicy.printPolicy(out); });
+  }
+}
+
 /**
  *  Arduino setup function
  */
@@ -90,29 +416,54 @@ void setup()
   bool ready = false;
   if (config.load(CONFIG_TAG::FILENAME))
   {
+    bootTimeline.mark(BootTimeline::PHASE::CONFIG_LOADED);
     try
     {
-      // init WiFi (station mode, DHCP, auto modem sleep after 10 s idle, auto wakeup every 100 ms * AP DTIM interval)
+      // set language of error message if defined in config
+      if (config.exists(CONFIG_TAG::MQTT_ERROR_LANG))
+      {
+        String lang = config.get(CONFIG_TAG::MQTT_ERROR_LANG);
+        language = lang == "EN"? LANG::EN : (lang == "DE"? LANG::DE : LANG::CODE);
+      }
+
+      // set bus silence until idle mode if defined in config
+      if (config.exists(CONFIG_TAG::IDLE_DELAY))
+      {
+        idleDelay = 1000UL*atoi(config.get(CONFIG_TAG::IDLE_DELAY));
+      }
+
+      // set flush period of telemetry history if defined in config
+      if (config.exists(CONFIG_TAG::HISTORY_FLUSH))
+      {
+        historyFlushPeriod = 60000UL*atoi(config.get(CONFIG_TAG::HISTORY_FLUSH));
+      }
+
+      // init whirlpool I/O immediately to acquire pool state while WiFi is connecting
+      pureSpaIO.setup(language, radioPolicy);
+
+      // init WiFi (station mode, DHCP or cached IP config, auto modem sleep after 10 s idle, auto wakeup every 100 ms * AP DTIM interval)
       WiFi.mode(WIFI_STA);
-      WiFi.begin(config.get(CONFIG_TAG::WIFI_SSID), config.get(CONFIG_TAG::WIFI_PASSPHRASE));
+      wifiBootCache.begin(config.get(CONFIG_TAG::WIFI_SSID), config.get(CONFIG_TAG::WIFI_PASSPHRASE));
 
       // init MQTT
       bool retainAll = config.exists(CONFIG_TAG::MQTT_RETAIN)? strcmp(config.get(CONFIG_TAG::MQTT_RETAIN), "no") != 0 : false;
       mqttPublisher.setRetainAll(retainAll);
 
-      mqttClient.addMetadata(MQTT_TOPIC::MODEL, pureSpaIO.getModelName());
       mqttClient.addMetadata(MQTT_TOPIC::VERSION, CONFIG::WIFI_VERSION);
 
-      mqttClient.addSubscriber(MQTT_TOPIC::CMD_BUBBLE, [](bool b) -> void { pureSpaIO.setBubbleOn(b); });
-      mqttClient.addSubscriber(MQTT_TOPIC::CMD_FILTER, [](bool b) -> void { pureSpaIO.setFilterOn(b); });
-      mqttClient.addSubscriber(MQTT_TOPIC::CMD_HEATER, [](bool b) -> void { pureSpaIO.setHeaterOn(b); });
-      mqttClient.addSubscriber(MQTT_TOPIC::CMD_POWER,  [](bool b) -> void { pureSpaIO.setPowerOn(b); });
-      mqttClient.addSubscriber(MQTT_TOPIC::CMD_WATER,  [](int i) -> void { pureSpaIO.setDesiredWaterTempCelsius(i); });
-      if (pureSpaIO.getModel() == PureSpaIO::MODEL::SJBHS)
-      {
-        mqttClient.addSubscriber(MQTT_TOPIC::CMD_DISINFECTION, [](int i) -> void { pureSpaIO.setDisinfectionTime(i); });
-        mqttClient.addSubscriber(MQTT_TOPIC::CMD_JET,          [](bool b) -> void { pureSpaIO.setJetOn(b); });
-      }
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_BUBBLE, [](bool b) -> void { beginCommand(CommandLatency::COMMAND::BUBBLE);     pureSpaIO.setBubbleOn(b); endCommand(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_FILTER, [](bool b) -> void { beginCommand(CommandLatency::COMMAND::FILTER);     pureSpaIO.setFilterOn(b); endCommand(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_HEATER, [](bool b) -> void { beginCommand(CommandLatency::COMMAND::HEATER);     pureSpaIO.setHeaterOn(b); endCommand(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_POWER,  [](bool b) -> void { beginCommand(CommandLatency::COMMAND::POWER);      pureSpaIO.setPowerOn(b); endCommand(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_WATER,  [](int i) -> void  { beginCommand(CommandLatency::COMMAND::WATER_TEMP); pureSpaIO.setDesiredWaterTempCelsius(i); endCommand(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_SCENE,  [](const byte* p, unsigned int l) -> void { sceneCommand(p, l); });
+
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_HEAP_ASSERT, [](bool b) -> void { HeapTracker::setAssertNoAlloc(b); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_METRICS, [](bool b) -> void { if (b) mqttPublisher.requestMetrics(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_CAPTURE, [](int i) -> void { if (i > 0) pureSpaIO.startCapture(i); else pureSpaIO.stopCapture(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_CAPTURE_RING, [](int i) -> void { if (i > 0) pureSpaIO.startCapture(i, true); else pureSpaIO.stopCapture(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_CAPTURE_TRIG, [](bool b) -> void { if (b) pureSpaIO.triggerCapture(); });
+      mqttClient.addSubscriber(MQTT_TOPIC::CMD_HISTORY, [](const byte* p, unsigned int l) -> void { history.request(p, l); });
 
       // enable OTA update if URL is defined in config
       if (config.exists(CONFIG_TAG::WIFI_OTA_URL))
@@ -120,11 +471,12 @@ void setup()
         mqttClient.addSubscriber(MQTT_TOPIC::CMD_OTA,  [](bool b) -> void { if (b) otaUpdate.start(config.get(CONFIG_TAG::WIFI_OTA_URL), mqttClient); });
       }
 
-      // set language of error message if defined in config
-      if (config.exists(CONFIG_TAG::MQTT_ERROR_LANG))
+      // enable OTA update via MQTT stream if enabled in config
+      if (config.exists(CONFIG_TAG::MQTT_OTA) && strcmp(config.get(CONFIG_TAG::MQTT_OTA), "no") != 0)
       {
-        String lang = config.get(CONFIG_TAG::MQTT_ERROR_LANG);
-        language = lang == "EN"? LANG::EN : (lang == "DE"? LANG::DE : LANG::CODE);
+        mqttClient.setBufferSize(OTAUpdate::STREAM_MESSAGE_SIZE);
+        mqttClient.addSubscriber(MQTT_TOPIC::CMD_OTA_BEGIN, [](const byte* p, unsigned int l) -> void { otaUpdate.beginStream(p, l, mqttClient); });
+        mqttClient.addSubscriber(MQTT_TOPIC::CMD_OTA_CHUNK, [](const byte* p, unsigned int l) -> void { otaUpdate.writeStream(p, l, mqttClient); });
       }
 
       // init MQTT client
@@ -144,9 +496,25 @@ void setup()
       }
       mqttClient.setup(config.get(CONFIG_TAG::MQTT_SERVER), mqttPort, username.c_str(), password.c_str(), pureSpaIO.getModelName(), MQTT_TOPIC::STATE, "offline");
 
+      // register model specific topics, deferred if model is not detected yet
+      setupModelSpecific();
+
       // init NTC thermometer
       thermometer.setup(22000, 3.33f, 320.f/100.f); // measured: 21990, 3.327f, 319.f/99.6f
 
+      // init telemetry history, restored from LittleFS if flushing is enabled
+      history.setup(historyFlushPeriod);
+
+      // init scheduler
+      poolTaskId    = scheduler.add("pool",    poolTask,    CONFIG::TASK_PERIOD);
+      busTaskId     = scheduler.add("bus",     busTask,     PureSpaIO::BUS_CHECK::PERIOD);
+      wifiTaskId    = scheduler.add("wifi",    wifiTask,    CONFIG::TASK_PERIOD);
+      mqttTaskId    = scheduler.add("mqtt",    mqttTask,    CONFIG::TASK_PERIOD);
+      publishTaskId = scheduler.add("publish", publishTask, CONFIG::TASK_PERIOD, []() -> bool { return online && pureSpaIO.isStateChanged(); });
+      otaTaskId     = scheduler.add("ota",     otaTask,     CONFIG::TASK_PERIOD);
+      idleTaskId    = scheduler.add("idle",    idleTask,    CONFIG::TASK_PERIOD, []() -> bool { return pureSpaIO.isWakeupPending(); });
+                      scheduler.add("stats",   statsTask,   CONFIG::WIFI_UPDATE_PERIOD);
+
       // enable hardware watchdog (8.3 s) by disabling software watchdog
       ESP.wdtDisable();
 
@@ -173,48 +541,8 @@ void loop()
   // keep hardware watchdog alive
   ESP.wdtFeed();
 
-  wl_status_t wifiStatus = WiFi.status(); //  WL_IDLE_STATUS 0, WL_NO_SSID_AVAIL 1, WL_SCAN_COMPLETED 2, WL_CONNECTED 3, WL_CONNECT_FAILED 4, WL_CONNECTION_LOST 5, WL_DISCONNECTED 6, WL_NO_SHIELD 255
-  unsigned long now = millis();
-  if (wifiStatus == WL_CONNECTED)
-  {
-    // WiFi is connected
-    disconnectTime = 0;
+  // run due tasks and idle until next task is due
+  scheduler.loop();
 
-    if (!initialized)
-    {
-      // publish client IP address
-      mqttClient.addMetadata(MQTT_TOPIC::IP, WiFi.localIP().toString().c_str());
-
-      // init whirlpool I/O after first WiFi connect
-      pureSpaIO.setup(language);
-      initialized = true;
-    }
-    else
-    {
-      // update MQTT
-      mqttClient.loop();
-      mqttPublisher.loop();
-
-      // update pool
-      pureSpaIO.loop();
-
-      // force idle
-      delay(100);
-    }
-  }
-  else
-  {
-    // restart ESP8266 if WiFi connection cannot be established
-    if (!disconnectTime)
-    {
-      // WiFi disconnected
-      disconnectTime = now;
-    }
-    else if (timeDiff(now, disconnectTime) > CONFIG::WIFI_MAX_DISCONNECT_DURATION)
-    {
-      // WiFi disconnected too long, restart ESP
-      DEBUG_MSG("restarting ... (no WiFi connection for several minutes)\n");
-      ESP.restart();
-    }
-  }
+  HeapTracker::loop();
 }
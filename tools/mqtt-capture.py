@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+# project:  Intex PureSpa WiFi Controller
+#
+# file:     mqtt-capture.py
+#
+# encoding: UTF-8
+# created:  18th October 2026
+#
+# Copyright (C) 2026 Jens B.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""
+record raw control panel frames on the WiFi controller and save them to a file
+
+file format: sequence of 32 bit little endian entries, each with the
+frame value in the low word and the time since the previous frame [µs]
+in the high word (cue frames are not recorded)
+
+requires: pip install paho-mqtt
+
+with --ring the frames are recorded continuously until a decoding error, a
+bus loss or a manual trigger (wifi/command/capture/trigger) freezes the ring
+
+example: mqtt-capture.py --host mqtt.at.home --frames 4096 capture.bin
+         mqtt-capture.py --host mqtt.at.home --ring --timeout 3600 capture.bin
+"""
+
+import argparse
+import json
+import struct
+import sys
+import threading
+
+import paho.mqtt.client as mqtt
+
+TOPIC_COMMAND = "wifi/command/capture"
+TOPIC_RING    = "wifi/command/capture/ring"
+TOPIC_DATA    = "wifi/capture/data"
+TOPIC_SUMMARY = "wifi/capture"
+
+TIMEOUT = 60 # [s]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="record raw frames via MQTT")
+    parser.add_argument("--host", required=True)
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--user")
+    parser.add_argument("--password")
+    parser.add_argument("--frames", type=int, default=4096)
+    parser.add_argument("--ring", action="store_true", help="record until triggered")
+    parser.add_argument("--timeout", type=int, default=TIMEOUT, help="[s]")
+    parser.add_argument("file")
+    args = parser.parse_args()
+
+    chunks = {}
+    done = threading.Event()
+    summary = {}
+
+    def on_connect(client, userdata, flags, rc):
+        client.subscribe(TOPIC_DATA)
+        client.subscribe(TOPIC_SUMMARY)
+        client.publish(TOPIC_RING if args.ring else TOPIC_COMMAND, str(args.frames))
+
+    def on_message(client, userdata, msg):
+        if msg.topic == TOPIC_DATA:
+            index = struct.unpack_from("<I", msg.payload)[0]
+            chunks[index] = msg.payload[4:]
+        else:
+            summary.update(json.loads(msg.payload))
+            done.set()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_start()
+    if not done.wait(args.timeout):
+        sys.exit("timeout")
+    client.loop_stop()
+
+    if "error" in summary:
+        sys.exit("capture failed: %s" % summary["error"])
+
+    data = b"".join(chunks[i] for i in sorted(chunks))
+    with open(args.file, "wb") as f:
+        f.write(data)
+    print("model %d, %d of %d frames saved" % (summary.get("model", 0), len(data)//4, summary.get("frames", 0)))
+    sys.exit(0 if summary.get("complete") and len(data)//4 == summary.get("frames") else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+#
+# project:  Intex PureSpa WiFi Controller
+#
+# file:     mqtt-ota-upload.py
+#
+# encoding: UTF-8
+# created:  18th October 2026
+#
+# Copyright (C) 2026 Jens B.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""
+stream a firmware image to the WiFi controller via MQTT
+
+requires: pip install paho-mqtt
+
+example: mqtt-ota-upload.py --host mqtt.at.home firmware.bin
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+TOPIC_BEGIN  = "wifi/command/update/begin"
+TOPIC_CHUNK  = "wifi/command/update/chunk"
+TOPIC_OFFSET = "wifi/update/offset"
+TOPIC_STATUS = "wifi/update"
+
+CHUNK_SIZE = 1024 # must not exceed OTAUpdate::STREAM_CHUNK_SIZE
+WINDOW     = 4    # max. number of unacknowledged chunks
+TIMEOUT    = 10   # [s] max. time without acknowledge
+
+
+def main():
+    parser = argparse.ArgumentParser(description="stream firmware image via MQTT")
+    parser.add_argument("--host", required=True)
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--user")
+    parser.add_argument("--password")
+    parser.add_argument("image")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    acked = threading.Condition()
+    state = {"offset": None, "status": None}
+
+    def on_connect(client, userdata, flags, rc):
+        client.subscribe(TOPIC_OFFSET)
+        client.subscribe(TOPIC_STATUS)
+
+    def on_message(client, userdata, msg):
+        payload = msg.payload.decode(errors="replace")
+        with acked:
+            if msg.topic == TOPIC_OFFSET:
+                state["offset"] = int(payload)
+            else:
+                state["status"] = payload
+                print(payload)
+            acked.notify()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_start()
+    time.sleep(1)
+
+    begin = '{"size":%d,"md5":"%s"}' % (len(image), hashlib.md5(image).hexdigest())
+    client.publish(TOPIC_BEGIN, begin)
+
+    start = time.time()
+    sent = 0
+    last_ack = None
+    with acked:
+        while True:
+            if not acked.wait_for(lambda: state["offset"] is not None or state["status"] is not None, TIMEOUT):
+                sys.exit("timeout")
+            status = state["status"]
+            if status is not None:
+                if status.startswith(("success", "failed")):
+                    break
+                state["status"] = None
+            ack = state["offset"]
+            state["offset"] = None
+            if ack is None or ack >= len(image):
+                continue
+
+            # repeated acknowledge: chunk was lost, go back to acknowledged offset
+            if ack == last_ack or sent < ack:
+                sent = ack
+            last_ack = ack
+
+            # send chunks until window is full
+            while sent < len(image) and sent < ack + WINDOW*CHUNK_SIZE:
+                chunk = image[sent:sent + CHUNK_SIZE]
+                client.publish(TOPIC_CHUNK, struct.pack("<I", sent) + chunk)
+                sent += len(chunk)
+
+    print("%d bytes in %.1f s" % (len(image), time.time() - start))
+    client.loop_stop()
+    sys.exit(0 if status.startswith("success") else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,203 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     CapturePlayer.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "CapturePlayer.h"
+
+#include <stdio.h>
+
+#include "common.h"
+
+
+namespace
+{
+  namespace FRAME
+  {
+    const uint16 CUE = 0x0100;
+    const uint16 DIGIT = 0x0040 | 0x0020 | 0x0800 | 0x0004;
+    const unsigned int BITS = 16;
+    const unsigned int CLOCK_PERIOD = 10; // µs, 100 kHz
+    const unsigned int DURATION = BITS*CLOCK_PERIOD; // µs
+  }
+
+  // event argument: frame 0 = cue, 1 = captured frame, bit 0..15
+  const uint32 FRAME_SHIFT = 4;
+
+  // same precedence as the decoder: cue, digit, LED, button
+  bool isDigit(uint16 frame)
+  {
+    return frame != FRAME::CUE && (frame & FRAME::DIGIT);
+  }
+}
+
+
+CapturePlayer::CapturePlayer(const std::vector<uint32>& entries) :
+  entries(entries)
+{
+}
+
+/**
+ * @param time of the first clock edge
+ */
+void CapturePlayer::start(sim::Time time)
+{
+  next = 0;
+  finished = entries.empty();
+  frameTime = time + (2*FRAME::DURATION + FRAME::CLOCK_PERIOD)*sim::US;
+  previousDigit = false;
+  if (!finished)
+  {
+    scheduleFrame();
+  }
+}
+
+bool CapturePlayer::isFinished() const
+{
+  return finished;
+}
+
+/**
+ * @return true if a cue frame was sent before the entry: before each digit
+ *         frame and after the last digit frame, if the gap allows it
+ */
+bool CapturePlayer::isCueMissing(uint32 entry, bool first, bool digit, bool previousDigit)
+{
+  return (digit || previousDigit) && (first || (entry >> 16) >= 2*(FRAME::DURATION + FRAME::CLOCK_PERIOD));
+}
+
+/**
+ * @param entries capture
+ * @param frames frame values of the capture with the cue frames reinserted
+ */
+void CapturePlayer::expand(const std::vector<uint32>& entries, std::vector<uint16>& frames)
+{
+  frames.clear();
+  bool previousDigit = false;
+  for (size_t i=0; i<entries.size(); i++)
+  {
+    uint16 frame = entries[i] & 0xFFFF;
+    bool digit = isDigit(frame);
+    if (isCueMissing(entries[i], i == 0, digit, previousDigit))
+    {
+      frames.push_back(FRAME::CUE);
+    }
+    frames.push_back(frame);
+    previousDigit = digit;
+  }
+}
+
+/**
+ * schedule the clock edges of the next entry and the cue frame in front
+ * of it, the frame ends after the captured delay, but not before the
+ * previous frame is complete
+ */
+void CapturePlayer::scheduleFrame()
+{
+  uint32 entry = entries[next];
+  if (next)
+  {
+    sim::Time delta = (entry >> 16)*sim::US;
+    sim::Time minDelta = (FRAME::DURATION + FRAME::CLOCK_PERIOD)*sim::US;
+    frameTime += delta > minDelta? delta : minDelta;
+  }
+  uint16 frame = entry & 0xFFFF;
+  bool digit = isDigit(frame);
+  bool cue = isCueMissing(entry, next == 0, digit, previousDigit);
+  previousDigit = digit;
+  frames[0] = FRAME::CUE;
+  frames[1] = frame;
+  next++;
+
+  sim::Time firstEdge = frameTime - (FRAME::BITS - 1)*FRAME::CLOCK_PERIOD*sim::US;
+  for (unsigned int b=0; b<FRAME::BITS; b++)
+  {
+    if (cue)
+    {
+      sim::Time cueEdge = firstEdge - (FRAME::DURATION + FRAME::CLOCK_PERIOD)*sim::US;
+      sim::schedule(cueEdge + b*FRAME::CLOCK_PERIOD*sim::US, *this, b);
+    }
+    sim::schedule(firstEdge + b*FRAME::CLOCK_PERIOD*sim::US, *this, (1 << FRAME_SHIFT) | b);
+  }
+}
+
+void CapturePlayer::event(uint32 arg)
+{
+  uint16 frame = frames[arg >> FRAME_SHIFT];
+  unsigned int b = arg & ((1 << FRAME_SHIFT) - 1);
+  sim::drivePin(PIN::DATA, !((frame >> (FRAME::BITS - 1 - b)) & 1));
+  sim::drivePin(PIN::LATCH, b == FRAME::BITS - 1);
+  sim::risingEdge(PIN::CLOCK);
+  if ((arg >> FRAME_SHIFT) && b == FRAME::BITS - 1)
+  {
+    if (next < entries.size())
+    {
+      scheduleFrame();
+    }
+    else
+    {
+      finished = true;
+    }
+  }
+}
+
+/**
+ * @return false if the file cannot be read or is not a multiple of 4 bytes
+ */
+bool CapturePlayer::load(const char* path, std::vector<uint32>& entries)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+  {
+    return false;
+  }
+  entries.clear();
+  unsigned char data[4];
+  size_t size;
+  while ((size = fread(data, 1, sizeof(data), file)) == sizeof(data))
+  {
+    entries.push_back(data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32)data[3] << 24));
+  }
+  bool success = size == 0 && !ferror(file);
+  fclose(file);
+
+  return success;
+}
+
+bool CapturePlayer::save(const char* path, const std::vector<uint32>& entries)
+{
+  FILE* file = fopen(path, "wb");
+  if (!file)
+  {
+    return false;
+  }
+  for (uint32 entry : entries)
+  {
+    unsigned char data[4] = { (unsigned char)entry, (unsigned char)(entry >> 8), (unsigned char)(entry >> 16), (unsigned char)(entry >> 24) };
+    fwrite(data, 1, sizeof(data), file);
+  }
+  bool success = !ferror(file);
+
+  return (fclose(file) == 0) && success;
+}
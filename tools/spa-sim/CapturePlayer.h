@@ -0,0 +1,72 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     CapturePlayer.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef CAPTURE_PLAYER_H
+#define CAPTURE_PLAYER_H
+
+#include <vector>
+
+#include "SimCore.h"
+
+/**
+ * Replays a frame capture of PureSpaIO on the simulated bus
+ *
+ * Each capture entry holds a frame value (low word) and the µs since the
+ * previous entry (high word), taken when the frame was complete. The frames
+ * are clocked out bit by bit like by the mainboard, ending at their capture
+ * time. Cue frames are not captured and are reinserted before each digit
+ * frame and after the last digit frame of a group, if the gap allows it.
+ *
+ * The capture files are the binary downloads of tools/mqtt-capture.py
+ * (32 bit little endian entries).
+ */
+class CapturePlayer : public sim::Device
+{
+public:
+  explicit CapturePlayer(const std::vector<uint32>& entries);
+
+  void start(sim::Time time);
+  void event(uint32 arg) override;
+  bool isFinished() const;
+
+  static bool load(const char* path, std::vector<uint32>& entries);
+  static bool save(const char* path, const std::vector<uint32>& entries);
+  static void expand(const std::vector<uint32>& entries, std::vector<uint16>& frames);
+
+private:
+  static bool isCueMissing(uint32 entry, bool first, bool digit, bool previousDigit);
+  void scheduleFrame();
+
+private:
+  const std::vector<uint32>& entries;
+  size_t next = 0;          // index of next entry to schedule
+  sim::Time frameTime = 0;  // last clock edge of the scheduled entry
+  uint16 frames[2] = {};    // cue (optional) and frame value of scheduled entry
+  bool previousDigit = false;
+  bool finished = false;
+};
+
+#endif /* CAPTURE_PLAYER_H */
@@ -0,0 +1,445 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     Mainboard.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "Mainboard.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+
+namespace
+{
+  namespace FRAME
+  {
+    const uint16 CUE = 0x0100;
+    const uint16 LED = 0x4000;
+    const uint16 BUTTON = 0x0100;
+    const unsigned int BITS = 16;
+    const unsigned int CLOCK_PERIOD = 10; // µs, 100 kHz
+  }
+
+  namespace SEGMENT
+  {
+    const uint16 A  = 0x2000;
+    const uint16 B  = 0x1000;
+    const uint16 C  = 0x0200;
+    const uint16 D  = 0x0400;
+    const uint16 E  = 0x0080;
+    const uint16 F  = 0x0008;
+    const uint16 G  = 0x0010;
+
+    const uint16 POS[4] = { 0x0040, 0x0020, 0x0800, 0x0004 };
+  }
+
+  struct Glyph
+  {
+    char c;
+    uint16 segments;
+  };
+
+  const Glyph GLYPHS[] = {
+    { ' ', 0 },
+    { '0', SEGMENT::A | SEGMENT::B | SEGMENT::C | SEGMENT::D | SEGMENT::E | SEGMENT::F },
+    { '1', SEGMENT::B | SEGMENT::C },
+    { '2', SEGMENT::A | SEGMENT::B | SEGMENT::G | SEGMENT::E | SEGMENT::D },
+    { '3', SEGMENT::A | SEGMENT::B | SEGMENT::C | SEGMENT::D | SEGMENT::G },
+    { '4', SEGMENT::F | SEGMENT::G | SEGMENT::B | SEGMENT::C },
+    { '5', SEGMENT::A | SEGMENT::F | SEGMENT::G | SEGMENT::C | SEGMENT::D },
+    { '6', SEGMENT::A | SEGMENT::F | SEGMENT::E | SEGMENT::D | SEGMENT::C | SEGMENT::G },
+    { '7', SEGMENT::A | SEGMENT::B | SEGMENT::C },
+    { '8', SEGMENT::A | SEGMENT::B | SEGMENT::C | SEGMENT::D | SEGMENT::E | SEGMENT::F | SEGMENT::G },
+    { '9', SEGMENT::A | SEGMENT::B | SEGMENT::C | SEGMENT::D | SEGMENT::F | SEGMENT::G },
+    { 'C', SEGMENT::A | SEGMENT::F | SEGMENT::E | SEGMENT::D },
+    { 'D', SEGMENT::B | SEGMENT::C | SEGMENT::D | SEGMENT::E | SEGMENT::G },
+    { 'E', SEGMENT::A | SEGMENT::F | SEGMENT::E | SEGMENT::D | SEGMENT::G },
+    { 'F', SEGMENT::E | SEGMENT::F | SEGMENT::A | SEGMENT::G },
+    { 'H', SEGMENT::B | SEGMENT::C | SEGMENT::E | SEGMENT::F | SEGMENT::G },
+    { 'N', SEGMENT::A | SEGMENT::B | SEGMENT::C | SEGMENT::E | SEGMENT::F }
+  };
+
+  // LED masks per model: power, filter, heater on, heater standby, bubble, jet, disinfection, no beep
+  struct LedMasks
+  {
+    uint16 power, filter, heaterOn, heaterStandby, bubble, jet, disinfection, noBeep;
+  };
+
+  const LedMasks LEDS[] = {
+    { 0x0001, 0x1000, 0x0080, 0x0200, 0x0400, 0,      0,      0x0100 }, // SB-H20
+    { 0x0001, 0x1000, 0x0080, 0x0200, 0x0002, 0x0400, 0x2000, 0x0100 }  // SJB-HS
+  };
+
+  // button masks per model in order of Mainboard::BUTTON, 0 = not available
+  const uint16 BUTTON_MASKS[][Mainboard::BUTTONS] = {
+    { 0x0400, 0x0002, 0x8000, 0x0008, 0x1000, 0x0080, 0x2000, 0,      0      }, // SB-H20
+    { 0x0400, 0x0080, 0x8000, 0x0002, 0x1000, 0x0200, 0x2000, 0x0008, 0x0001 }  // SJB-HS
+  };
+
+  const char* const BUTTON_NAMES[] = { "power", "filter", "heater", "bubble", "tempUp", "tempDown", "tempUnit", "jet", "disinfection" };
+
+  const unsigned int DISPLAY_GROUPS = 5;
+  const unsigned int BLINK_PERIOD = 500;   // ms
+  const unsigned int BLINK_DURATION = 4000; // ms
+  const unsigned int TIME_DURATION = 4000;  // ms, disinfection time display
+  const int TEMP_MIN = 20; // °C
+  const int TEMP_MAX = 40; // °C
+
+  // event argument: frame index and bit or sample flag
+  const uint32 EVENT_CYCLE = 0xFFFFFFFFU;
+  const uint32 EVENT_SAMPLE = 0x80000000U;
+}
+
+
+Mainboard::Mainboard(const Config& config) :
+  config(config),
+  random(config.seed)
+{
+}
+
+/**
+ * start sending the frame cycle, the setpoint is blinking after start
+ *
+ * @param time of first cycle
+ */
+void Mainboard::start(sim::Time time)
+{
+  blinkStart = time;
+  blinkEnd = time + BLINK_DURATION*sim::MS;
+  sim::schedule(time, *this, EVENT_CYCLE);
+}
+
+/**
+ * record all frames except cue frames, entries: frame value (low word),
+ * µs since previous entry (high word), like PureSpaIO::startCapture()
+ *
+ * @param entries appended until the mainboard is destroyed
+ */
+void Mainboard::startCapture(std::vector<uint32>& entries)
+{
+  capture = &entries;
+  lastCaptureTime = sim::now();
+}
+
+const char* Mainboard::getButtonName(unsigned int button)
+{
+  return BUTTON_NAMES[button];
+}
+
+/**
+ * @param text 4 chars
+ * @param frames digit frames 1..4
+ */
+void Mainboard::buildDisplay(const char* text, uint16* frames)
+{
+  for (unsigned int i=0; i<4; i++)
+  {
+    uint16 segments = 0;
+    for (const Glyph& glyph : GLYPHS)
+    {
+      if (glyph.c == text[i])
+      {
+        segments = glyph.segments;
+        break;
+      }
+    }
+    frames[i] = SEGMENT::POS[i] | segments;
+  }
+}
+
+/**
+ * @param text 4 chars of current display content
+ */
+void Mainboard::updateDisplay(char* text) const
+{
+  sim::Time now = sim::now();
+  if (!spa.power)
+  {
+    strcpy(text, "    ");
+  }
+  else if (spa.error)
+  {
+    snprintf(text, 5, "%-4s", spa.error);
+  }
+  else if (now < blinkEnd)
+  {
+    bool blank = ((now - blinkStart)/(BLINK_PERIOD/2*sim::MS)) & 1;
+    snprintf(text, 5, blank? "    " : "%03dC", spa.desiredTemp);
+  }
+  else if (now < timeDisplayEnd)
+  {
+    snprintf(text, 5, "%03dH", spa.disinfection);
+  }
+  else
+  {
+    snprintf(text, 5, "%03dC", spa.waterTemp);
+  }
+}
+
+uint16 Mainboard::getLedFrame() const
+{
+  const LedMasks& led = LEDS[config.model];
+  uint16 frame = FRAME::LED;
+  if (spa.power)       frame |= led.power;
+  if (spa.filter)      frame |= led.filter;
+  if (spa.heater)      frame |= (spa.waterTemp < spa.desiredTemp)? led.heaterOn : led.heaterStandby;
+  if (spa.bubble)      frame |= led.bubble;
+  if (spa.jet)         frame |= led.jet;
+  if (spa.disinfection) frame |= led.disinfection;
+  if (sim::now() >= beepEnd) frame |= led.noBeep;
+
+  return frame;
+}
+
+/**
+ * build the frames of one cycle from the current state:
+ * 5x (C D1 C D2 C D3 C D4 C L), the buttons are sent before the last LED frame
+ *
+ * @param cycle frames without bit errors
+ */
+void Mainboard::buildCycle(std::vector<uint16>& cycle)
+{
+  char text[5];
+  updateDisplay(text);
+  uint16 digits[4];
+  buildDisplay(text, digits);
+  uint16 led = getLedFrame();
+
+  cycle.clear();
+  frameButtons.clear();
+  for (unsigned int group=0; group<DISPLAY_GROUPS; group++)
+  {
+    for (unsigned int digit=0; digit<4; digit++)
+    {
+      cycle.push_back(FRAME::CUE);
+      cycle.push_back(digits[digit]);
+    }
+    cycle.push_back(FRAME::CUE);
+    frameButtons.resize(cycle.size(), BUTTONS);
+    if (group == DISPLAY_GROUPS - 1)
+    {
+      for (unsigned int button=0; button<BUTTONS; button++)
+      {
+        uint16 mask = BUTTON_MASKS[config.model][button];
+        if (mask)
+        {
+          cycle.push_back(FRAME::BUTTON | mask);
+          frameButtons.push_back((BUTTON)button);
+        }
+      }
+    }
+    cycle.push_back(led);
+    frameButtons.push_back(BUTTONS);
+  }
+}
+
+void Mainboard::startCycle()
+{
+  if (statistics.cycles)
+  {
+    endCycle();
+  }
+  cycleTime = sim::now();
+  statistics.cycles++;
+
+  buildCycle(frames);
+  if (config.bitErrors)
+  {
+    for (uint16& frame : frames)
+    {
+      if (random() % 1000000 < config.bitErrors)
+      {
+        frame ^= 1U << (random() % FRAME::BITS);
+        statistics.bitErrors++;
+      }
+    }
+  }
+
+  // frames evenly distributed over the cycle, one event per clock edge
+  sim::Time slot = CYCLE::PERIOD*sim::US/frames.size();
+  for (unsigned int f=0; f<frames.size(); f++)
+  {
+    sim::Time frameTime = cycleTime + f*slot;
+    for (unsigned int b=0; b<FRAME::BITS; b++)
+    {
+      sim::schedule(frameTime + (b*FRAME::CLOCK_PERIOD + FRAME::CLOCK_PERIOD/2)*sim::US, *this, (f << 4) | b);
+    }
+    if (frameButtons[f] != BUTTONS)
+    {
+      sim::Time lastEdge = frameTime + ((FRAME::BITS - 1)*FRAME::CLOCK_PERIOD + FRAME::CLOCK_PERIOD/2)*sim::US;
+      sim::schedule(lastEdge + config.samplePoint, *this, EVENT_SAMPLE | f);
+    }
+  }
+  sim::schedule(cycleTime + CYCLE::PERIOD*sim::US, *this, EVENT_CYCLE);
+}
+
+/**
+ * evaluate reply pulses of the last cycle per button
+ */
+void Mainboard::endCycle()
+{
+  unsigned int period = CYCLE::PERIOD/1000;
+  for (unsigned int i=0; i<BUTTONS; i++)
+  {
+    Button& button = buttons[i];
+    if (button.pressed)
+    {
+      button.held += period;
+      if (!button.accepted && button.held >= config.pressDuration)
+      {
+        button.accepted = true;
+        button.nextRepeat = config.repeatDelay;
+        if (random() % 100 < config.missedPresses)
+        {
+          statistics.missedPresses++;
+        }
+        else
+        {
+          press((BUTTON)i);
+          if (random() % 100 < config.doubleTriggers)
+          {
+            statistics.doubleTriggers++;
+            press((BUTTON)i);
+          }
+        }
+      }
+      else if (button.accepted && button.held >= button.nextRepeat)
+      {
+        button.nextRepeat += config.repeatPeriod;
+        statistics.autoRepeats++;
+        press((BUTTON)i);
+      }
+    }
+    else
+    {
+      button.held = 0;
+      button.accepted = false;
+    }
+    button.pressed = false;
+  }
+}
+
+void Mainboard::press(BUTTON button)
+{
+  if (!spa.power && button != POWER)
+  {
+    return;
+  }
+
+  sim::Time now = sim::now();
+  statistics.presses[button]++;
+  beepEnd = now + config.beepDuration*sim::MS;
+  switch (button)
+  {
+    case POWER:
+      spa.power = !spa.power;
+      if (!spa.power)
+      {
+        spa.heater = spa.filter = spa.bubble = spa.jet = false;
+        spa.disinfection = 0;
+        blinkEnd = timeDisplayEnd = 0;
+      }
+      break;
+
+    case FILTER:
+      spa.filter = !spa.filter;
+      spa.heater &= spa.filter;
+      break;
+
+    case HEATER:
+      spa.heater = !spa.heater;
+      spa.filter |= spa.heater;
+      break;
+
+    case BUBBLE:
+      spa.bubble = !spa.bubble;
+      break;
+
+    case JET:
+      spa.jet = !spa.jet;
+      break;
+
+    case DISINFECTION:
+      spa.disinfection = (spa.disinfection == 0)? 3 : (spa.disinfection == 3)? 5 : (spa.disinfection == 5)? 8 : 0;
+      timeDisplayEnd = now + TIME_DURATION*sim::MS;
+      blinkEnd = 0;
+      break;
+
+    case TEMP_UP:
+    case TEMP_DOWN:
+      // first press enters setpoint mode
+      if (now < blinkEnd)
+      {
+        spa.desiredTemp += (button == TEMP_UP)? 1 : -1;
+        spa.desiredTemp = spa.desiredTemp < TEMP_MIN? TEMP_MIN : spa.desiredTemp > TEMP_MAX? TEMP_MAX : spa.desiredTemp;
+      }
+      blinkStart = now;
+      blinkEnd = now + BLINK_DURATION*sim::MS;
+      timeDisplayEnd = 0;
+      break;
+
+    default:
+      break;
+  }
+}
+
+void Mainboard::event(uint32 arg)
+{
+  if (arg == EVENT_CYCLE)
+  {
+    startCycle();
+  }
+  else if (arg & EVENT_SAMPLE)
+  {
+    // mainboard releases DATA, low level is the reply of the control panel
+    unsigned int f = arg & ~EVENT_SAMPLE;
+    sim::drivePin(PIN::DATA, true);
+    if (!sim::readPin(PIN::DATA))
+    {
+      buttons[frameButtons[f]].pressed = true;
+      statistics.replies++;
+    }
+  }
+  else
+  {
+    unsigned int f = arg >> 4;
+    unsigned int b = arg & 0xF;
+    sim::drivePin(PIN::DATA, !((frames[f] >> (FRAME::BITS - 1 - b)) & 1));
+    sim::drivePin(PIN::LATCH, b == FRAME::BITS - 1);
+    sim::risingEdge(PIN::CLOCK);
+    if (b == FRAME::BITS - 1)
+    {
+      statistics.frames++;
+      if (capture && frames[f] != FRAME::CUE)
+      {
+        sim::Time now = sim::now();
+        uint32 delta = (now - lastCaptureTime)/sim::US;
+        capture->push_back(((delta < 0xFFFF? delta : 0xFFFF) << 16) | frames[f]);
+        lastCaptureTime = now;
+      }
+    }
+  }
+}
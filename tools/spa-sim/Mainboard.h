@@ -0,0 +1,170 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     Mainboard.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef MAINBOARD_H
+#define MAINBOARD_H
+
+#include <random>
+#include <vector>
+
+#include "SimCore.h"
+
+/**
+ * Simulated mainboard of the Intex PureSpa SB-H20 and SJB-HS
+ *
+ * Sends the 21 ms frame cycle of cue, digit, LED and button frames bit by
+ * bit (100 kHz clock, data inverted, MSB first, latch low for the first
+ * 15 bits) and samples the DATA line after each button frame to detect a
+ * reply pulse of the control panel.
+ *
+ * A button is accepted after it has been held for the press duration, the
+ * buzzer is turned on for the beep duration. Holding it longer than the
+ * repeat delay triggers an auto repeat. Pressing temp up or down shows the
+ * setpoint blinking for 4 s, the first press only enters the setpoint mode.
+ * The setpoint is also blinking for 4 s after start.
+ *
+ * Missed presses, double triggers and bit errors can be injected. The sent
+ * frames can be recorded in the capture format of PureSpaIO.
+ *
+ * notes:
+ * - the protocol constants are repeated here instead of being shared with
+ *   PureSpaIO to keep the simulation independent of the decoder
+ * - the frame order inside a cycle and the timing of the mainboard are
+ *   assumptions based on the protocol description in PureSpaIO.h
+ */
+class Mainboard : public sim::Device
+{
+public:
+  enum MODEL
+  {
+    SBH20 = 0,
+    SJBHS
+  };
+
+  enum BUTTON
+  {
+    POWER = 0,
+    FILTER,
+    HEATER,
+    BUBBLE,
+    TEMP_UP,
+    TEMP_DOWN,
+    TEMP_UNIT,
+    JET,
+    DISINFECTION,
+    BUTTONS
+  };
+
+  class CYCLE
+  {
+  public:
+    static const unsigned int PERIOD = 21000; // µs
+  };
+
+  struct Config
+  {
+    MODEL model = SBH20;
+    sim::Time samplePoint = 4*sim::US;  // DATA sampling after last clock edge of a button frame
+    unsigned int pressDuration = 100;   // ms, hold time until a press is accepted
+    unsigned int repeatDelay = 1000;    // ms, hold time until auto repeat
+    unsigned int repeatPeriod = 250;    // ms
+    unsigned int beepDuration = 150;    // ms
+    unsigned int missedPresses = 0;     // %, accepted presses ignored
+    unsigned int doubleTriggers = 0;    // %, accepted presses executed twice
+    unsigned int bitErrors = 0;         // ppm of frames with one bit inverted
+    uint32 seed = 1;
+  };
+
+  struct Spa
+  {
+    bool power = true;
+    bool heater = false;
+    bool filter = false;
+    bool bubble = false;
+    bool jet = false;
+    int disinfection = 0; // h
+    int desiredTemp = 37; // °C
+    int waterTemp = 30;   // °C
+    const char* error = nullptr; // e.g. "E90"
+  };
+
+  struct Statistics
+  {
+    unsigned int cycles = 0;
+    unsigned int frames = 0;
+    unsigned int bitErrors = 0;
+    unsigned int replies = 0;        // button frames with reply pulse
+    unsigned int presses[BUTTONS] = {};
+    unsigned int autoRepeats = 0;
+    unsigned int doubleTriggers = 0;
+    unsigned int missedPresses = 0;
+  };
+
+public:
+  explicit Mainboard(const Config& config);
+
+  void start(sim::Time time);
+  void event(uint32 arg) override;
+  void startCapture(std::vector<uint32>& entries);
+
+  void buildCycle(std::vector<uint16>& frames);
+  static void buildDisplay(const char* text, uint16* frames);
+  static const char* getButtonName(unsigned int button);
+
+  Spa spa;
+  Statistics statistics;
+
+private:
+  void startCycle();
+  void endCycle();
+  void press(BUTTON button);
+  void updateDisplay(char* text) const;
+  uint16 getLedFrame() const;
+
+private:
+  struct Button
+  {
+    unsigned int held = 0;         // ms
+    unsigned int nextRepeat = 0;   // ms of hold time
+    bool pressed = false;          // reply pulse in current cycle
+    bool accepted = false;
+  };
+
+  Config config;
+  std::mt19937 random;
+  Button buttons[BUTTONS];
+  std::vector<uint16> frames;
+  std::vector<BUTTON> frameButtons;
+  sim::Time cycleTime = 0;
+  sim::Time blinkStart = 0;
+  sim::Time blinkEnd = 0;
+  sim::Time beepEnd = 0;
+  sim::Time timeDisplayEnd = 0;
+  std::vector<uint32>* capture = nullptr;
+  sim::Time lastCaptureTime = 0;
+};
+
+#endif /* MAINBOARD_H */
@@ -0,0 +1,380 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     SimCore.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#include "SimCore.h"
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <coredecls.h>
+
+#include <queue>
+#include <random>
+#include <vector>
+
+
+namespace
+{
+  struct Event
+  {
+    sim::Time time;
+    uint64_t sequence;
+    sim::Device* device;
+    uint32 arg;
+
+    bool operator>(const Event& other) const
+    {
+      return time != other.time? time > other.time : sequence > other.sequence;
+    }
+  };
+
+  const unsigned int PINS = 17;
+  const sim::Time TIMER1_TICK_NS_X2 = 25; // 2x 12.5 ns (80 MHz, TIM_DIV1)
+
+  struct Core
+  {
+    sim::Time time = 0;
+    uint64_t sequence = 0;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    bool scheduled = false;
+
+    uint32 driven = 0xFFFFFFFFU; // pin levels driven by the mainboard, high if released
+    uint32 outputEnable = 0;
+    uint32 outputValue = 0;
+
+    voidFuncPtrArg isr[PINS] = {};
+    void* isrArg[PINS] = {};
+    sim::Time isrLatency = 0;
+    sim::Time isrJitter = 0;
+    std::mt19937 random;
+
+    timercallback timer1Callback = nullptr;
+    bool timer1Enabled = false;
+    uint32 timer1Generation = 0;
+
+    uint32 rtcMemory[128] = {};
+
+    sim::Counters counters;
+  };
+
+  Core core;
+
+  void updateInputs()
+  {
+    GPI = core.driven & ~(core.outputEnable & ~core.outputValue);
+  }
+
+  class ClockInterrupt : public sim::Device
+  {
+  public:
+    void event(uint32 pin) override
+    {
+      core.counters.clockInterrupts++;
+      core.isr[pin](core.isrArg[pin]);
+    }
+  } clockInterrupt;
+
+  class Timer1Interrupt : public sim::Device
+  {
+  public:
+    void event(uint32 generation) override
+    {
+      if (core.timer1Enabled && core.timer1Callback && generation == core.timer1Generation)
+      {
+        core.counters.timerInterrupts++;
+        core.timer1Callback();
+      }
+    }
+  } timer1Interrupt;
+}
+
+
+/**
+ * reset time, pending events, pins and interrupts, RTC memory is kept like
+ * on a reset of the ESP8266
+ */
+void sim::reset()
+{
+  uint32 rtcMemory[128];
+  memcpy(rtcMemory, core.rtcMemory, sizeof(rtcMemory));
+  core = Core();
+  memcpy(core.rtcMemory, rtcMemory, sizeof(rtcMemory));
+  updateInputs();
+}
+
+sim::Time sim::now()
+{
+  return core.time;
+}
+
+/**
+ * set time directly, e.g. to feed frames without the event queue
+ *
+ * @param time must not be earlier than the current time
+ */
+void sim::setTime(Time time)
+{
+  core.time = time;
+}
+
+void sim::schedule(Time time, Device& device, uint32 arg)
+{
+  core.events.push({ time, core.sequence++, &device, arg });
+}
+
+/**
+ * process pending events in time order
+ *
+ * @param until end of period
+ * @param wakeup return early if an ISR calls esp_schedule()
+ * @return true if returned early
+ */
+bool sim::run(Time until, bool wakeup)
+{
+  while (!core.events.empty() && core.events.top().time <= until)
+  {
+    Event e = core.events.top();
+    core.events.pop();
+    core.time = e.time;
+    core.counters.events++;
+    e.device->event(e.arg);
+    if (wakeup && core.scheduled)
+    {
+      core.scheduled = false;
+      return true;
+    }
+  }
+  if (until > core.time)
+  {
+    core.time = until;
+  }
+
+  return false;
+}
+
+/**
+ * @param latency delay from clock edge to ISR entry
+ * @param jitter max. additional random delay, uniformly distributed
+ * @param seed of random generator
+ */
+void sim::setIsrLatency(Time latency, Time jitter, uint32 seed)
+{
+  core.isrLatency = latency;
+  core.isrJitter = jitter;
+  core.random.seed(seed);
+}
+
+void sim::drivePin(uint8 pin, bool level)
+{
+  core.driven = level? core.driven | bit(pin) : core.driven & ~bit(pin);
+  updateInputs();
+}
+
+bool sim::readPin(uint8 pin)
+{
+  return GPI & bit(pin);
+}
+
+/**
+ * rising edge on pin, the attached ISR is called after the configured latency
+ */
+void sim::risingEdge(uint8 pin)
+{
+  if (pin < PINS && core.isr[pin])
+  {
+    Time latency = core.isrLatency;
+    if (core.isrJitter)
+    {
+      latency += core.random() % (core.isrJitter + 1);
+    }
+    if (latency)
+    {
+      schedule(core.time + latency, clockInterrupt, pin);
+    }
+    else
+    {
+      clockInterrupt.event(pin);
+    }
+  }
+}
+
+/**
+ * @return ISR attached to the pin or nullptr
+ */
+void (*sim::getInterrupt(uint8 pin, void*& arg))(void*)
+{
+  arg = pin < PINS? core.isrArg[pin] : nullptr;
+  return pin < PINS? core.isr[pin] : nullptr;
+}
+
+const sim::Counters& sim::getCounters()
+{
+  return core.counters;
+}
+
+/*
+ * Arduino Core API
+ */
+
+volatile uint32_t GPI = 0xFFFFFFFFU;
+
+GPIORegister GPOS = { [](uint32_t mask) { core.outputValue |= mask; updateInputs(); } };
+GPIORegister GPOC = { [](uint32_t mask) { core.outputValue &= ~mask; updateInputs(); } };
+GPIORegister GPES = { [](uint32_t mask) { core.outputEnable |= mask; updateInputs(); } };
+GPIORegister GPEC = { [](uint32_t mask) { core.outputEnable &= ~mask; updateInputs(); } };
+
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  core.outputEnable = (mode == OUTPUT)? core.outputEnable | bit(pin) : core.outputEnable & ~bit(pin);
+  updateInputs();
+}
+
+int digitalRead(uint8_t pin)
+{
+  return sim::readPin(pin)? HIGH : LOW;
+}
+
+void attachInterruptArg(uint8_t pin, voidFuncPtrArg isr, void* arg, int mode)
+{
+  if (pin < PINS && mode == RISING)
+  {
+    core.isr[pin] = isr;
+    core.isrArg[pin] = arg;
+  }
+}
+
+unsigned long millis()
+{
+  return core.time/sim::MS;
+}
+
+unsigned long micros()
+{
+  return core.time/sim::US;
+}
+
+void delay(unsigned long ms)
+{
+  sim::run(core.time + ms*sim::MS, false);
+}
+
+void yield()
+{
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+void timer1_attachInterrupt(timercallback userFunc)
+{
+  core.timer1Callback = userFunc;
+}
+
+void timer1_enable(uint8_t divider, uint8_t intType, uint8_t reload)
+{
+  (void)divider;
+  (void)intType;
+  (void)reload;
+  core.timer1Enabled = true;
+}
+
+void timer1_write(uint32_t ticks)
+{
+  core.timer1Generation++;
+  sim::schedule(core.time + ticks*TIMER1_TICK_NS_X2/2, timer1Interrupt, core.timer1Generation);
+}
+
+uint32_t EspClass::getCycleCount()
+{
+  return (uint32_t)(core.time*(F_CPU/1000000)/1000);
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+{
+  if (offset*4 + size > sizeof(core.rtcMemory))
+  {
+    return false;
+  }
+  memcpy(data, (uint8*)core.rtcMemory + offset*4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+{
+  if (offset*4 + size > sizeof(core.rtcMemory))
+  {
+    return false;
+  }
+  memcpy((uint8*)core.rtcMemory + offset*4, data, size);
+  return true;
+}
+
+void esp_schedule()
+{
+  core.scheduled = true;
+}
+
+void esp_delay(unsigned long ms)
+{
+  if (core.scheduled)
+  {
+    core.scheduled = false;
+    return;
+  }
+  sim::run(core.time + ms*sim::MS, true);
+}
+
+void esp_delay(unsigned long timeout, const std::function<bool()>& blocked, unsigned long interval)
+{
+  unsigned long start = millis();
+  unsigned long expired;
+  while ((expired = millis() - start) < timeout && blocked())
+  {
+    unsigned long remaining = timeout - expired;
+    esp_delay(remaining <= interval? remaining : interval);
+  }
+}
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc)
+{
+  const uint8* p = (const uint8*)data;
+  while (length--)
+  {
+    crc ^= *p++;
+    for (unsigned int i=0; i<8; i++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & -(crc & 1));
+    }
+  }
+  return crc;
+}
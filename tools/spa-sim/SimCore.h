@@ -0,0 +1,81 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     SimCore.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_CORE_H
+#define SIM_CORE_H
+
+#include <c_types.h>
+
+/**
+ * Event driven simulation of the parts of the ESP8266 used by PureSpaIO:
+ * time, GPIO input and output registers, the clock pin interrupt, timer1,
+ * RTC user memory and the cooperative scheduling of the main loop.
+ *
+ * The simulated time only advances while the firmware waits (delay() and
+ * esp_delay()), pending events like clock edges are processed in time order
+ * and ISRs run to completion in zero simulated time.
+ *
+ * The DATA line is open drain: its level is low if the mainboard drives it
+ * low or if the ESP8266 enables its output driver (output value is low).
+ */
+namespace sim
+{
+  typedef uint64_t Time; // [ns]
+
+  const Time US = 1000;
+  const Time MS = 1000*US;
+
+  class Device
+  {
+  public:
+    virtual ~Device() = default;
+    virtual void event(uint32 arg) = 0;
+  };
+
+  void reset();
+  Time now();
+  void setTime(Time time);
+
+  void schedule(Time time, Device& device, uint32 arg);
+  bool run(Time until, bool wakeup);
+
+  void setIsrLatency(Time latency, Time jitter, uint32 seed);
+  void drivePin(uint8 pin, bool level);
+  bool readPin(uint8 pin);
+  void risingEdge(uint8 pin);
+  void (*getInterrupt(uint8 pin, void*& arg))(void*);
+
+  struct Counters
+  {
+    uint64_t events = 0;
+    uint64_t clockInterrupts = 0;
+    uint64_t timerInterrupts = 0;
+  };
+
+  const Counters& getCounters();
+}
+
+#endif /* SIM_CORE_H */
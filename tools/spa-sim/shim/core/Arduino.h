@@ -0,0 +1,111 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     Arduino.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c_types.h"
+#include "pgmspace.h"
+#include "WString.h"
+#include "Print.h"
+
+/**
+ * host substitute of the Arduino Core for ESP8266, covers the API used by
+ * the simulated modules, implemented by the simulator (SimCore.cpp)
+ */
+
+#define INPUT  0x00
+#define OUTPUT 0x01
+
+#define LOW  0x0
+#define HIGH 0x1
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define bit(b) (1UL << (b))
+#define digitalPinToInterrupt(p) (p)
+
+typedef void (*voidFuncPtrArg)(void*);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void attachInterruptArg(uint8_t pin, voidFuncPtrArg isr, void* arg, int mode);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+void noInterrupts();
+void interrupts();
+
+// GPIO registers: input levels and write only set/clear registers of the
+// output value (GPOS/GPOC) and the output enable (GPES/GPEC)
+extern volatile uint32_t GPI;
+
+struct GPIORegister
+{
+  void (*update)(uint32_t mask);
+  void operator=(uint32_t mask) { update(mask); }
+};
+
+extern GPIORegister GPOS;
+extern GPIORegister GPOC;
+extern GPIORegister GPES;
+extern GPIORegister GPEC;
+
+// timer1
+#define TIM_DIV1   0
+#define TIM_DIV16  1
+#define TIM_DIV256 3
+#define TIM_EDGE   0
+#define TIM_LEVEL  1
+#define TIM_SINGLE 0
+#define TIM_LOOP   1
+
+typedef void (*timercallback)(void);
+
+void timer1_attachInterrupt(timercallback userFunc);
+void timer1_enable(uint8_t divider, uint8_t intType, uint8_t reload);
+void timer1_write(uint32_t ticks);
+
+class EspClass
+{
+public:
+  uint32_t getCycleCount();
+  void wdtFeed() {}
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+};
+
+extern EspClass ESP;
+
+#endif /* SIM_ARDUINO_H */
@@ -0,0 +1,72 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     ESP8266WiFi.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_ESP8266WIFI_H
+#define SIM_ESP8266WIFI_H
+
+#include "Arduino.h"
+
+/**
+ * host substitute of the WiFi API used by the simulated modules, there is
+ * no radio, the settings are only stored
+ */
+enum WiFiSleepType_t
+{
+  WIFI_NONE_SLEEP = 0,
+  WIFI_LIGHT_SLEEP = 1,
+  WIFI_MODEM_SLEEP = 2
+};
+
+class ESP8266WiFiClass
+{
+public:
+  int32_t RSSI() { return -60; }
+  WiFiSleepType_t getSleepMode() { return sleepMode; }
+  bool setSleepMode(WiFiSleepType_t type) { sleepMode = type; return true; }
+  void setOutputPower(float dBm) { outputPower = dBm; }
+  bool forceSleepBegin() { return true; }
+  bool forceSleepWake() { return true; }
+
+private:
+  WiFiSleepType_t sleepMode = WIFI_NONE_SLEEP;
+  float outputPower = 20.5f;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+enum GPIO_INT_TYPE
+{
+  GPIO_PIN_INTR_DISABLE = 0,
+  GPIO_PIN_INTR_LOLEVEL = 4,
+  GPIO_PIN_INTR_HILEVEL = 5
+};
+
+#define GPIO_ID_PIN(n) (n)
+
+inline void wifi_enable_gpio_wakeup(uint32 pin, GPIO_INT_TYPE type) { (void)pin; (void)type; }
+inline void wifi_disable_gpio_wakeup() {}
+
+#endif /* SIM_ESP8266WIFI_H */
@@ -0,0 +1,84 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     Print.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_PRINT_H
+#define SIM_PRINT_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include "c_types.h"
+#include <stdio.h>
+#include "WString.h"
+
+/**
+ * host substitute of the Arduino Print class
+ */
+class Print
+{
+public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+    {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int n) { return printf("%d", n); }
+  size_t print(unsigned int n) { return printf("%u", n); }
+  size_t print(long n) { return printf("%ld", n); }
+  size_t print(unsigned long n) { return printf("%lu", n); }
+  size_t print(long long n) { return printf("%lld", n); }
+  size_t print(unsigned long long n) { return printf("%llu", n); }
+  size_t print(double n) { return printf("%.2f", n); }
+
+  template<typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    va_list args;
+    va_start(args, format);
+    char buffer[256];
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return n > 0? write((const uint8_t*)buffer, (size_t)n < sizeof(buffer)? n : sizeof(buffer) - 1) : 0;
+  }
+
+  template<typename... Args> size_t printf_P(const char* format, Args... args) { return printf(format, args...); }
+};
+
+#endif /* SIM_PRINT_H */
@@ -0,0 +1,46 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     c_types.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_C_TYPES_H
+#define SIM_C_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * host substitute of the ESP8266 SDK types, section attributes are ignored
+ */
+typedef uint8_t  uint8;
+typedef int8_t   sint8;
+typedef uint16_t uint16;
+typedef int16_t  sint16;
+typedef uint32_t uint32;
+typedef int32_t  sint32;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#endif /* SIM_C_TYPES_H */
@@ -0,0 +1,49 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     coredecls.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_COREDECLS_H
+#define SIM_COREDECLS_H
+
+#include <functional>
+#include "c_types.h"
+
+/**
+ * host substitute of the cooperative scheduling of the Arduino Core for
+ * ESP8266: esp_delay() advances the simulated time and returns early if an
+ * ISR calls esp_schedule()
+ */
+void esp_schedule();
+void esp_delay(unsigned long ms);
+void esp_delay(unsigned long timeout, const std::function<bool()>& blocked, unsigned long interval);
+
+inline void esp_delay(unsigned long timeout, const std::function<bool()>& blocked)
+{
+  esp_delay(timeout, blocked, timeout);
+}
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0xffffffff);
+
+#endif /* SIM_COREDECLS_H */
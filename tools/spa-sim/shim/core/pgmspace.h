@@ -0,0 +1,38 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     pgmspace.h
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+#ifndef SIM_PGMSPACE_H
+#define SIM_PGMSPACE_H
+
+#include <string.h>
+
+/**
+ * host substitute of the flash access macros, flash is plain memory
+ */
+#define PROGMEM
+#define PSTR(s) (s)
+
+#endif /* SIM_PGMSPACE_H */
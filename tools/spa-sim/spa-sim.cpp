@@ -0,0 +1,1025 @@
+/*
+ * project:  Intex PureSpa WiFi Controller
+ *
+ * file:     spa-sim.cpp
+ *
+ * encoding: UTF-8
+ * created:  18th October 2026
+ *
+ * Copyright (C) 2026 Jens B.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+
+/*
+ * Host simulation of the control panel side of the Intex PureSpa bus:
+ * the unmodified PureSpaIO (and RadioPolicy) runs against a simulated
+ * mainboard through a GPIO/time shim of the Arduino Core for ESP8266.
+ *
+ * sim:    closed loop test of button commands, reports command success
+ *         rates and latencies
+ * replay: feeds a frame capture through the decoder and prints the decoded
+ *         state timeline, optionally compared with an expected timeline
+ * bench:  calls the clock ISR with synthetic or captured frames and reports
+ *         ns and instructions per frame type
+ *
+ * The simulation is deterministic for a given seed and runs much faster
+ * than real time.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "PureSpaIO.h"
+#include "RadioPolicy.h"
+#include "CapturePlayer.h"
+#include "Mainboard.h"
+#include "SimCore.h"
+
+
+namespace
+{
+  enum COMMAND
+  {
+    BUBBLE = 0,
+    FILTER,
+    HEATER,
+    POWER,
+    JET,
+    DISINFECTION,
+    WATER,
+    COMMANDS
+  };
+
+  const char* const COMMAND_NAMES[COMMANDS] = { "bubble", "filter", "heater", "power", "jet", "disinfection", "water" };
+
+  const unsigned long STARTUP_DURATION = 5000; // ms, covers blinking of setpoint after start
+
+  struct Options
+  {
+    Mainboard::Config mainboard;
+    sim::Time latency = 1*sim::US;
+    sim::Time jitter = 0;
+    unsigned int commands = 100;
+    unsigned long pause = 1000; // ms
+    double minSuccess = 0; // %
+    bool json = false;
+    const char* capture = nullptr; // sim: file to record the frames of the mainboard
+    const char* expect = nullptr;  // replay: file with expected timeline
+    const char* input = nullptr;   // replay, bench: capture file
+    unsigned long frames = 500000; // bench: min. frames per ISR
+  };
+
+  struct CommandStats
+  {
+    unsigned int runs = 0;
+    unsigned int reached = 0;            // mainboard state matches target
+    unsigned int outcomes[PureSpaIO::OUTCOME::UNSUPPORTED + 1] = {};
+    unsigned int falseConfirmations = 0; // confirmed, but target not reached
+    unsigned int presses = 0;
+    unsigned int retries = 0;
+    unsigned int repeats = 0;
+    std::vector<unsigned long> durations; // ms
+    double reply = 0;   // ms, sum
+    double ack = 0;     // ms, sum
+    double confirm = 0; // ms, sum
+    unsigned int replies = 0;
+    unsigned int acks = 0;
+    unsigned int confirms = 0;
+  };
+
+  class Simulation
+  {
+  public:
+    explicit Simulation(const Options& options) :
+      options(options),
+      mainboard(options.mainboard),
+      random(options.mainboard.seed)
+    {
+    }
+
+    int run();
+
+  private:
+    void runFirmware(unsigned long duration);
+    void runCommand(COMMAND command);
+    COMMAND selectCommand();
+    void report(double realTime) const;
+    void reportJSON(double realTime) const;
+
+  private:
+    const Options& options;
+    Mainboard mainboard;
+    PureSpaIO pureSpaIO;
+    RadioPolicy radioPolicy;
+    std::mt19937 random;
+    CommandStats stats[COMMANDS];
+    unsigned long lastLoopTime = 0;
+    unsigned int waterTempErrors = 0; // decoded actual water temp differs from mainboard
+    unsigned int waterTempSamples = 0;
+    std::vector<uint32> capture;
+  };
+
+  class Replay
+  {
+  public:
+    explicit Replay(const Options& options) :
+      options(options),
+      player(entries)
+    {
+    }
+
+    int run();
+
+  private:
+    void sampleState();
+    bool compare() const;
+
+  private:
+    const Options& options;
+    std::vector<uint32> entries;
+    CapturePlayer player;
+    PureSpaIO pureSpaIO;
+    RadioPolicy radioPolicy;
+    std::vector<std::string> timeline;
+    std::string lastState;
+  };
+
+  enum FRAME_CLASS
+  {
+    CUE_FRAME = 0,
+    DIGIT_FRAME,
+    LED_FRAME,
+    BUTTON_FRAME,
+    OTHER_FRAME,
+    FRAME_CLASSES
+  };
+
+  const char* const FRAME_CLASS_NAMES[FRAME_CLASSES] = { "cue", "digit", "led", "button", "other" };
+
+  struct FrameCost
+  {
+    std::vector<float> ns;   // per frame
+    uint64_t frames = 0;     // frames with counted instructions
+    double instructions = 0; // sum
+  };
+
+  class Benchmark
+  {
+  public:
+    explicit Benchmark(const Options& options) :
+      options(options),
+      mainboard(options.mainboard),
+      player(entries)
+    {
+    }
+
+    int run();
+
+  private:
+    bool prepare();
+    void sendFrame(uint16 frame);
+    void measureTime(FrameCost* costs);
+    bool measureInstructions(FrameCost* costs);
+    void report(const FrameCost* decoder, const FrameCost* baseline, bool instructions) const;
+    void reportJSON(const FrameCost* decoder, const FrameCost* baseline, bool instructions) const;
+
+  private:
+    const Options& options;
+    std::vector<uint32> entries;
+    Mainboard mainboard;
+    CapturePlayer player;
+    PureSpaIO pureSpaIO;
+    RadioPolicy radioPolicy;
+    std::vector<uint16> stream;
+  };
+
+  bool parseTime(const char* value, sim::Time& time)
+  {
+    char* end;
+    double us = strtod(value, &end);
+    time = (sim::Time)(us*sim::US + 0.5);
+    return *end == '\0' && us >= 0;
+  }
+}
+
+
+/**
+ * run main loop tasks of the firmware with their nominal periods
+ *
+ * @param duration ms
+ */
+void Simulation::runFirmware(unsigned long duration)
+{
+  unsigned long end = millis() + duration;
+  while (millis() < end)
+  {
+    delay(PureSpaIO::BUS_CHECK::PERIOD);
+    pureSpaIO.checkBusHealth();
+    if (millis() - lastLoopTime >= CONFIG::TASK_PERIOD)
+    {
+      lastLoopTime = millis();
+      pureSpaIO.loop();
+      radioPolicy.loop(pureSpaIO.getErrorRate(), pureSpaIO.getBusHealth() == PureSpaIO::BUS_OK);
+
+      int waterTemp = pureSpaIO.getActWaterTempCelsius();
+      if (pureSpaIO.isOnline() && waterTemp != PureSpaIO::UNDEF::INT)
+      {
+        waterTempSamples++;
+        waterTempErrors += waterTemp != mainboard.spa.waterTemp;
+      }
+    }
+  }
+}
+
+/**
+ * @return random command that changes the state, power on if off
+ */
+COMMAND Simulation::selectCommand()
+{
+  if (!mainboard.spa.power)
+  {
+    return POWER;
+  }
+
+  static const COMMAND SBH20[] = { BUBBLE, FILTER, HEATER, WATER, BUBBLE, FILTER, HEATER, WATER, POWER };
+  static const COMMAND SJBHS[] = { BUBBLE, FILTER, HEATER, WATER, JET, DISINFECTION, BUBBLE, FILTER, HEATER, WATER, JET, DISINFECTION, POWER };
+  if (options.mainboard.model == Mainboard::SJBHS)
+  {
+    return SJBHS[random() % (sizeof(SJBHS)/sizeof(SJBHS[0]))];
+  }
+  else
+  {
+    return SBH20[random() % (sizeof(SBH20)/sizeof(SBH20[0]))];
+  }
+}
+
+void Simulation::runCommand(COMMAND command)
+{
+  Mainboard::Spa& spa = mainboard.spa;
+  int target;
+  pureSpaIO.startCommandResult();
+  pureSpaIO.startCommandTiming(micros());
+  switch (command)
+  {
+    case BUBBLE:
+      target = !spa.bubble;
+      pureSpaIO.setBubbleOn(target);
+      target = spa.bubble == (bool)target;
+      break;
+
+    case FILTER:
+      target = !spa.filter;
+      pureSpaIO.setFilterOn(target);
+      target = spa.filter == (bool)target;
+      break;
+
+    case HEATER:
+      target = !spa.heater;
+      pureSpaIO.setHeaterOn(target);
+      target = spa.heater == (bool)target;
+      break;
+
+    case POWER:
+      target = !spa.power;
+      pureSpaIO.setPowerOn(target);
+      target = spa.power == (bool)target;
+      break;
+
+    case JET:
+      target = !spa.jet;
+      pureSpaIO.setJetOn(target);
+      target = spa.jet == (bool)target;
+      break;
+
+    case DISINFECTION:
+    {
+      static const int HOURS[] = { 0, 3, 5, 8 };
+      do
+      {
+        target = HOURS[random() % 4];
+      } while (target == spa.disinfection);
+      pureSpaIO.setDisinfectionTime(target);
+      target = spa.disinfection == target;
+      break;
+    }
+
+    default:
+      do
+      {
+        target = PureSpaIO::WATER_TEMP::SET_MIN + random() % (PureSpaIO::WATER_TEMP::SET_MAX - PureSpaIO::WATER_TEMP::SET_MIN + 1);
+      } while (target == spa.desiredTemp);
+      pureSpaIO.setDesiredWaterTempCelsius(target);
+      target = spa.desiredTemp == target;
+      break;
+  }
+  bool reached = target;
+
+  PureSpaIO::CommandResult result;
+  pureSpaIO.getCommandResult(result);
+  PureSpaIO::CommandTiming timing;
+  pureSpaIO.getCommandTiming(timing);
+  pureSpaIO.stopCommandTiming();
+
+  CommandStats& s = stats[command];
+  s.runs++;
+  s.reached += reached;
+  s.outcomes[result.outcome]++;
+  s.falseConfirmations += result.outcome == PureSpaIO::OUTCOME::CONFIRMED && !reached;
+  s.presses += result.presses;
+  s.retries += result.retries;
+  s.repeats += result.repeats;
+  s.durations.push_back(result.duration);
+  if (timing.reply)
+  {
+    s.reply += (timing.reply - timing.start)/1000.0;
+    s.replies++;
+  }
+  if (timing.ack)
+  {
+    s.ack += (timing.ack - timing.start)/1000.0;
+    s.acks++;
+  }
+  if (timing.confirm)
+  {
+    s.confirm += (timing.confirm - timing.start)/1000.0;
+    s.confirms++;
+  }
+}
+
+int Simulation::run()
+{
+  auto realStart = std::chrono::steady_clock::now();
+
+  sim::reset();
+  sim::setIsrLatency(options.latency, options.jitter, options.mainboard.seed);
+  mainboard.start(0);
+  if (options.capture)
+  {
+    mainboard.startCapture(capture);
+  }
+  pureSpaIO.setup(LANG::EN, radioPolicy);
+  runFirmware(STARTUP_DURATION);
+
+  if (!pureSpaIO.isStateComplete())
+  {
+    fprintf(stderr, "state incomplete after start\n");
+  }
+
+  for (unsigned int i=0; i<options.commands; i++)
+  {
+    runCommand(selectCommand());
+    runFirmware(options.pause);
+  }
+
+  double realTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+  if (options.capture && !CapturePlayer::save(options.capture, capture))
+  {
+    fprintf(stderr, "failed to write %s\n", options.capture);
+    return 2;
+  }
+  if (options.json)
+  {
+    reportJSON(realTime);
+  }
+  else
+  {
+    report(realTime);
+  }
+
+  unsigned int runs = 0;
+  unsigned int reached = 0;
+  for (const CommandStats& s : stats)
+  {
+    runs += s.runs;
+    reached += s.reached;
+  }
+  return (runs && 100.0*reached/runs < options.minSuccess)? 1 : 0;
+}
+
+namespace
+{
+  unsigned long percentile(std::vector<unsigned long> values, unsigned int p)
+  {
+    if (values.empty())
+    {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1)*p/100];
+  }
+
+  double average(const std::vector<unsigned long>& values)
+  {
+    double sum = 0;
+    for (unsigned long v : values)
+    {
+      sum += v;
+    }
+    return values.empty()? 0 : sum/values.size();
+  }
+}
+
+void Simulation::report(double realTime) const
+{
+  printf("model %s, %.1f s simulated in %.2f s\n\n", pureSpaIO.getModelName(), sim::now()/1e9, realTime);
+  printf("command       runs reached confirmed unconfirmed failed false   avg ms  p95 ms  max ms  reply ms  ack ms  confirm ms  presses retries repeats\n");
+  unsigned int runs = 0;
+  unsigned int reached = 0;
+  for (unsigned int c=0; c<COMMANDS; c++)
+  {
+    const CommandStats& s = stats[c];
+    if (!s.runs)
+    {
+      continue;
+    }
+    runs += s.runs;
+    reached += s.reached;
+    printf("%-12s %5u %7u %9u %11u %6u %5u %8.0f %7lu %7lu %9.0f %7.0f %11.0f %8u %7u %7u\n",
+           COMMAND_NAMES[c], s.runs, s.reached,
+           s.outcomes[PureSpaIO::OUTCOME::CONFIRMED], s.outcomes[PureSpaIO::OUTCOME::UNCONFIRMED], s.outcomes[PureSpaIO::OUTCOME::FAILED],
+           s.falseConfirmations,
+           average(s.durations), percentile(s.durations, 95), percentile(s.durations, 100),
+           s.replies? s.reply/s.replies : 0, s.acks? s.ack/s.acks : 0, s.confirms? s.confirm/s.confirms : 0,
+           s.presses, s.retries, s.repeats);
+  }
+  printf("\nsuccess rate %.1f %% (%u of %u commands reached their target)\n", runs? 100.0*reached/runs : 0, reached, runs);
+
+  const Mainboard::Statistics& m = mainboard.statistics;
+  printf("mainboard: %u frames, %u bit errors, %u reply frames, %u auto repeats, %u double triggers, %u missed presses\n",
+         m.frames, m.bitErrors, m.replies, m.autoRepeats, m.doubleTriggers, m.missedPresses);
+  printf("decoder: %u frames, %u dropped, error rate %u ppm, water temp wrong in %u of %u samples\n",
+         pureSpaIO.getTotalFrames(), pureSpaIO.getDroppedFrames(), pureSpaIO.getErrorRate(), waterTempErrors, waterTempSamples);
+}
+
+void Simulation::reportJSON(double realTime) const
+{
+  unsigned int runs = 0;
+  unsigned int reached = 0;
+  for (const CommandStats& s : stats)
+  {
+    runs += s.runs;
+    reached += s.reached;
+  }
+
+  printf("{\"model\":\"%s\",\"seed\":%u,\"simulatedMs\":%llu,\"realMs\":%.0f,\"runs\":%u,\"reached\":%u,\"successRate\":%.2f,\"commands\":{",
+         pureSpaIO.getModelName(), options.mainboard.seed, (unsigned long long)(sim::now()/sim::MS), 1000*realTime,
+         runs, reached, runs? 100.0*reached/runs : 0);
+  bool first = true;
+  for (unsigned int c=0; c<COMMANDS; c++)
+  {
+    const CommandStats& s = stats[c];
+    if (!s.runs)
+    {
+      continue;
+    }
+    printf("%s\"%s\":{\"runs\":%u,\"reached\":%u,\"confirmed\":%u,\"unconfirmed\":%u,\"failed\":%u,\"falseConfirmations\":%u,"
+           "\"durationMs\":{\"avg\":%.1f,\"p95\":%lu,\"max\":%lu},\"replyMs\":%.1f,\"ackMs\":%.1f,\"confirmMs\":%.1f,"
+           "\"presses\":%u,\"retries\":%u,\"repeats\":%u}",
+           first? "" : ",", COMMAND_NAMES[c], s.runs, s.reached,
+           s.outcomes[PureSpaIO::OUTCOME::CONFIRMED], s.outcomes[PureSpaIO::OUTCOME::UNCONFIRMED], s.outcomes[PureSpaIO::OUTCOME::FAILED],
+           s.falseConfirmations,
+           average(s.durations), percentile(s.durations, 95), percentile(s.durations, 100),
+           s.replies? s.reply/s.replies : 0, s.acks? s.ack/s.acks : 0, s.confirms? s.confirm/s.confirms : 0,
+           s.presses, s.retries, s.repeats);
+    first = false;
+  }
+
+  const Mainboard::Statistics& m = mainboard.statistics;
+  printf("},\"mainboard\":{\"frames\":%u,\"bitErrors\":%u,\"replies\":%u,\"autoRepeats\":%u,\"doubleTriggers\":%u,\"missedPresses\":%u},"
+         "\"decoder\":{\"frames\":%u,\"dropped\":%u,\"errorRate\":%u,\"waterTempErrors\":%u,\"waterTempSamples\":%u}}\n",
+         m.frames, m.bitErrors, m.replies, m.autoRepeats, m.doubleTriggers, m.missedPresses,
+         pureSpaIO.getTotalFrames(), pureSpaIO.getDroppedFrames(), pureSpaIO.getErrorRate(), waterTempErrors, waterTempSamples);
+}
+
+/**
+ * add a timeline entry if the decoded state changed, time is ms since
+ * start of replay
+ */
+void Replay::sampleState()
+{
+  char value[4][8];
+  int values[3] = { pureSpaIO.getActWaterTempCelsius(), pureSpaIO.getDesiredWaterTempCelsius(), pureSpaIO.getDisinfectionTime() };
+  for (unsigned int i=0; i<3; i++)
+  {
+    if (values[i] == PureSpaIO::UNDEF::INT)
+    {
+      strcpy(value[i], "-");
+    }
+    else
+    {
+      snprintf(value[i], sizeof(value[i]), "%d", values[i]);
+    }
+  }
+  unsigned int led = pureSpaIO.getRawLedValue();
+  if (led == PureSpaIO::UNDEF::USHORT)
+  {
+    strcpy(value[3], "-");
+  }
+  else
+  {
+    snprintf(value[3], sizeof(value[3]), "%04x", led);
+  }
+
+  char state[160];
+  snprintf(state, sizeof(state), "model=%s bus=%s led=%s water=%s desired=%s disinfection=%s error=%u buzzer=%u",
+           pureSpaIO.getModelName(), pureSpaIO.getBusHealthName(), value[3], value[0], value[1], value[2],
+           pureSpaIO.getErrorCode(), pureSpaIO.isBuzzerOn());
+  if (lastState != state)
+  {
+    lastState = state;
+    char line[180];
+    snprintf(line, sizeof(line), "%7lu %s", millis(), state);
+    timeline.push_back(line);
+    printf("%s\n", line);
+  }
+}
+
+/**
+ * @return true if the timeline matches the expected timeline, otherwise
+ *         the first difference is printed
+ */
+bool Replay::compare() const
+{
+  FILE* file = fopen(options.expect, "r");
+  if (!file)
+  {
+    fprintf(stderr, "failed to read %s\n", options.expect);
+    return false;
+  }
+  std::vector<std::string> expected;
+  char line[256];
+  while (fgets(line, sizeof(line), file))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    expected.push_back(line);
+  }
+  fclose(file);
+
+  for (size_t i=0; i<timeline.size() || i<expected.size(); i++)
+  {
+    const char* actual = i < timeline.size()? timeline[i].c_str() : "<end>";
+    const char* wanted = i < expected.size()? expected[i].c_str() : "<end>";
+    if (strcmp(actual, wanted))
+    {
+      fprintf(stderr, "%s: timeline differs at line %zu\n  expected: %s\n  actual:   %s\n", options.expect, i + 1, wanted, actual);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int Replay::run()
+{
+  if (!CapturePlayer::load(options.input, entries))
+  {
+    fprintf(stderr, "failed to read %s\n", options.input);
+    return 2;
+  }
+
+  auto realStart = std::chrono::steady_clock::now();
+  sim::reset();
+  sim::setIsrLatency(options.latency, options.jitter, options.mainboard.seed);
+  player.start(0);
+  pureSpaIO.setup(LANG::EN, radioPolicy);
+
+  // main loop tasks with their nominal periods until shortly after the last frame
+  unsigned long lastLoopTime = 0;
+  unsigned long end = 0;
+  while (!end || millis() < end)
+  {
+    delay(PureSpaIO::BUS_CHECK::PERIOD);
+    pureSpaIO.checkBusHealth();
+    if (millis() - lastLoopTime >= CONFIG::TASK_PERIOD)
+    {
+      lastLoopTime = millis();
+      pureSpaIO.loop();
+      radioPolicy.loop(pureSpaIO.getErrorRate(), pureSpaIO.getBusHealth() == PureSpaIO::BUS_OK);
+      sampleState();
+    }
+    if (!end && player.isFinished())
+    {
+      end = millis() + 2*CONFIG::TASK_PERIOD;
+    }
+  }
+
+  double realTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+  fprintf(stderr, "replayed %zu frames, %.1f s in %.2f s (%.0fx real time), decoder: %u frames, %u dropped, error rate %u ppm\n",
+          entries.size(), sim::now()/1e9, realTime, realTime > 0? sim::now()/1e9/realTime : 0,
+          pureSpaIO.getTotalFrames(), pureSpaIO.getDroppedFrames(), pureSpaIO.getErrorRate());
+
+  return (options.expect && !compare())? 1 : 0;
+}
+
+namespace
+{
+  // frame classification with the precedence of the decoder
+  unsigned int classifyFrame(uint16 frame)
+  {
+    if (frame == 0x0100) return CUE_FRAME;
+    if (frame & 0x0864)  return DIGIT_FRAME;
+    if (frame & 0x4000)  return LED_FRAME;
+    if (frame & 0x0100)  return BUTTON_FRAME;
+    return OTHER_FRAME;
+  }
+
+  IRAM_ATTR void idleISR(void*)
+  {
+  }
+
+  int openInstructionCounter()
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  uint64_t readCounter(int fd)
+  {
+    uint64_t value = 0;
+    return read(fd, &value, sizeof(value)) == sizeof(value)? value : 0;
+  }
+
+  double median(std::vector<float> values)
+  {
+    if (values.empty())
+    {
+      return 0;
+    }
+    std::nth_element(values.begin(), values.begin() + values.size()/2, values.end());
+    return values[values.size()/2];
+  }
+
+  // all frame types combined
+  FrameCost total(const FrameCost* costs)
+  {
+    FrameCost sum;
+    for (unsigned int c=0; c<FRAME_CLASSES; c++)
+    {
+      sum.ns.insert(sum.ns.end(), costs[c].ns.begin(), costs[c].ns.end());
+      sum.frames += costs[c].frames;
+      sum.instructions += costs[c].instructions;
+    }
+    return sum;
+  }
+
+  // per frame: decoder minus idle ISR, median for time, average for instructions
+  double netTime(const FrameCost& decoder, const FrameCost& baseline)
+  {
+    double ns = median(decoder.ns) - median(baseline.ns);
+    return ns > 0? ns : 0;
+  }
+
+  double netInstructions(const FrameCost& decoder, const FrameCost& baseline)
+  {
+    if (!decoder.frames || !baseline.frames)
+    {
+      return 0;
+    }
+    double instructions = decoder.instructions/decoder.frames - baseline.instructions/baseline.frames;
+    return instructions > 0? instructions : 0;
+  }
+}
+
+/**
+ * attach the clock ISR of the model by running the setup of the decoder
+ * with the simulated mainboard or the capture and build the frame stream
+ *
+ * @return false if the capture cannot be read
+ */
+bool Benchmark::prepare()
+{
+  sim::reset();
+  sim::setIsrLatency(options.latency, 0, options.mainboard.seed);
+  if (options.input)
+  {
+    if (!CapturePlayer::load(options.input, entries) || entries.empty())
+    {
+      fprintf(stderr, "failed to read %s\n", options.input);
+      return false;
+    }
+    CapturePlayer::expand(entries, stream);
+    player.start(0);
+  }
+  else
+  {
+    // some cycles with different display and LED states
+    mainboard.start(0);
+    Mainboard::Spa& spa = mainboard.spa;
+    std::vector<uint16> cycle;
+    for (int i=0; i<16; i++)
+    {
+      spa.waterTemp = 22 + i;
+      spa.filter = i & 1;
+      spa.bubble = i & 2;
+      spa.heater = i & 4;
+      mainboard.buildCycle(cycle);
+      stream.insert(stream.end(), cycle.begin(), cycle.end());
+    }
+    spa = Mainboard::Spa();
+  }
+  pureSpaIO.setup(LANG::EN, radioPolicy);
+  if (pureSpaIO.getModel() == PureSpaIO::MODEL::UNKNOWN)
+  {
+    fprintf(stderr, "model not detected, benchmarking model detection\n");
+  }
+
+  // call ISR synchronously, the scheduled bus events are no longer processed
+  sim::setIsrLatency(0, 0, options.mainboard.seed);
+
+  return true;
+}
+
+/**
+ * clock one frame into the ISR, like the mainboard
+ */
+void Benchmark::sendFrame(uint16 frame)
+{
+  for (unsigned int b=0; b<16; b++)
+  {
+    sim::drivePin(PIN::DATA, !((frame >> (15 - b)) & 1));
+    sim::drivePin(PIN::LATCH, b == 15);
+    sim::risingEdge(PIN::CLOCK);
+  }
+}
+
+/**
+ * time each frame of one pass of the stream
+ */
+void Benchmark::measureTime(FrameCost* costs)
+{
+  typedef std::chrono::steady_clock Clock;
+  for (uint16 frame : stream)
+  {
+    Clock::time_point start = Clock::now();
+    sendFrame(frame);
+    Clock::time_point end = Clock::now();
+    costs[classifyFrame(frame)].ns.push_back(std::chrono::duration<float, std::nano>(end - start).count());
+  }
+}
+
+/**
+ * count the user space instructions of each frame of the stream until
+ * options.frames are sent
+ *
+ * @return false if no hardware instruction counter is available
+ */
+bool Benchmark::measureInstructions(FrameCost* costs)
+{
+  int fd = openInstructionCounter();
+  if (fd < 0)
+  {
+    return false;
+  }
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  unsigned long sent = 0;
+  while (sent < options.frames)
+  {
+    for (uint16 frame : stream)
+    {
+      uint64_t start = readCounter(fd);
+      sendFrame(frame);
+      uint64_t end = readCounter(fd);
+      FrameCost& cost = costs[classifyFrame(frame)];
+      cost.frames++;
+      cost.instructions += end - start;
+      if (++sent >= options.frames)
+      {
+        break;
+      }
+    }
+  }
+  close(fd);
+
+  return true;
+}
+
+int Benchmark::run()
+{
+  if (!prepare())
+  {
+    return 2;
+  }
+
+  // alternating passes of the stream with the decoder and an idle ISR, the
+  // idle ISR is the baseline for clock, pin and dispatch overhead, the first
+  // pass only warms up caches and branch predictors
+  void* decoderArg;
+  voidFuncPtrArg decoderISR = sim::getInterrupt(PIN::CLOCK, decoderArg);
+  FrameCost decoder[FRAME_CLASSES];
+  FrameCost baseline[FRAME_CLASSES];
+  FrameCost warmup[FRAME_CLASSES];
+  for (unsigned long sent=0; sent<options.frames + stream.size(); sent+=stream.size())
+  {
+    attachInterruptArg(PIN::CLOCK, decoderISR, decoderArg, RISING);
+    measureTime(sent? decoder : warmup);
+    attachInterruptArg(PIN::CLOCK, idleISR, nullptr, RISING);
+    measureTime(sent? baseline : warmup);
+  }
+
+  attachInterruptArg(PIN::CLOCK, decoderISR, decoderArg, RISING);
+  bool instructions = measureInstructions(decoder);
+  attachInterruptArg(PIN::CLOCK, idleISR, nullptr, RISING);
+  instructions = instructions && measureInstructions(baseline);
+
+  if (options.json)
+  {
+    reportJSON(decoder, baseline, instructions);
+  }
+  else
+  {
+    report(decoder, baseline, instructions);
+  }
+
+  return 0;
+}
+
+void Benchmark::report(const FrameCost* decoder, const FrameCost* baseline, bool instructions) const
+{
+  printf("model %s, %s\n\n", pureSpaIO.getModelName(), options.input? options.input : "synthetic");
+  printf("frame      frames   ns/frame  baseline ns  instr/frame\n");
+  FrameCost decoderTotal = total(decoder);
+  FrameCost baselineTotal = total(baseline);
+  for (unsigned int c=0; c<=FRAME_CLASSES; c++)
+  {
+    const FrameCost& d = (c < FRAME_CLASSES)? decoder[c] : decoderTotal;
+    const FrameCost& b = (c < FRAME_CLASSES)? baseline[c] : baselineTotal;
+    if (d.ns.empty())
+    {
+      continue;
+    }
+    char instr[16] = "-";
+    if (instructions)
+    {
+      snprintf(instr, sizeof(instr), "%.0f", netInstructions(d, b));
+    }
+    printf("%-8s %8zu %10.1f %12.1f %12s\n", (c < FRAME_CLASSES)? FRAME_CLASS_NAMES[c] : "all",
+           d.ns.size(), netTime(d, b), median(b.ns), instr);
+  }
+}
+
+namespace
+{
+  void printCostJSON(const FrameCost& decoder, const FrameCost& baseline, bool instructions)
+  {
+    char instr[16] = "null";
+    if (instructions)
+    {
+      snprintf(instr, sizeof(instr), "%.1f", netInstructions(decoder, baseline));
+    }
+    printf("{\"frames\":%zu,\"nsPerFrame\":%.1f,\"baselineNs\":%.1f,\"instructionsPerFrame\":%s}",
+           decoder.ns.size(), netTime(decoder, baseline), median(baseline.ns), instr);
+  }
+}
+
+void Benchmark::reportJSON(const FrameCost* decoder, const FrameCost* baseline, bool instructions) const
+{
+  printf("{\"model\":\"%s\",\"source\":\"%s\",\"types\":{",
+         pureSpaIO.getModelName(), options.input? options.input : "synthetic");
+  bool first = true;
+  for (unsigned int c=0; c<FRAME_CLASSES; c++)
+  {
+    if (!decoder[c].ns.empty())
+    {
+      printf("%s\"%s\":", first? "" : ",", FRAME_CLASS_NAMES[c]);
+      printCostJSON(decoder[c], baseline[c], instructions);
+      first = false;
+    }
+  }
+  printf("},\"all\":");
+  printCostJSON(total(decoder), total(baseline), instructions);
+  printf("}\n");
+}
+
+namespace
+{
+  void usage()
+  {
+    fprintf(stderr,
+      "usage: spa-sim sim [options]\n"
+      "       spa-sim replay CAPTURE [--expect TIMELINE] [--latency US] [--jitter US]\n"
+      "       spa-sim bench [CAPTURE] [--model sbh20|sjbhs] [--frames N] [--json]\n"
+      "\n"
+      "  --model sbh20|sjbhs  mainboard model (default sbh20)\n"
+      "  --commands N         number of random commands (default 100)\n"
+      "  --pause MS           idle time between commands (default 1000)\n"
+      "  --seed N             seed of random generators (default 1)\n"
+      "  --latency US         clock ISR entry latency (default 1)\n"
+      "  --jitter US          max. additional random ISR latency (default 0)\n"
+      "  --sample US          mainboard samples DATA after last clock edge (default 4)\n"
+      "  --press MS           hold time until a press is accepted (default 100)\n"
+      "  --repeat MS          hold time until auto repeat (default 1000)\n"
+      "  --beep MS            buzzer duration (default 150)\n"
+      "  --miss PCT           accepted presses ignored by the mainboard\n"
+      "  --double PCT         accepted presses executed twice\n"
+      "  --noise PPM          frames with one bit inverted\n"
+      "  --min-success PCT    exit with 1 if fewer commands reach their target\n"
+      "  --json               print result as JSON\n"
+      "  --capture FILE       record the frames of the mainboard in the capture format\n"
+      "  --expect FILE        exit with 1 if the replayed state timeline differs\n"
+      "  --frames N           min. benchmark frames (default 500000)\n");
+  }
+
+  bool parseOptions(int argc, char* argv[], int first, Options& options)
+  {
+    for (int i=first; i<argc; i++)
+    {
+      const char* name = argv[i];
+      if (!strcmp(name, "--json"))
+      {
+        options.json = true;
+        continue;
+      }
+      if (i + 1 >= argc)
+      {
+        return false;
+      }
+      const char* value = argv[++i];
+      unsigned long number = strtoul(value, nullptr, 10);
+      if (!strcmp(name, "--model"))
+      {
+        if (!strcmp(value, "sbh20"))      options.mainboard.model = Mainboard::SBH20;
+        else if (!strcmp(value, "sjbhs")) options.mainboard.model = Mainboard::SJBHS;
+        else return false;
+      }
+      else if (!strcmp(name, "--commands"))    options.commands = number;
+      else if (!strcmp(name, "--pause"))       options.pause = number;
+      else if (!strcmp(name, "--seed"))        options.mainboard.seed = number;
+      else if (!strcmp(name, "--latency"))     { if (!parseTime(value, options.latency)) return false; }
+      else if (!strcmp(name, "--jitter"))      { if (!parseTime(value, options.jitter)) return false; }
+      else if (!strcmp(name, "--sample"))      { if (!parseTime(value, options.mainboard.samplePoint)) return false; }
+      else if (!strcmp(name, "--press"))       options.mainboard.pressDuration = number;
+      else if (!strcmp(name, "--repeat"))      options.mainboard.repeatDelay = number;
+      else if (!strcmp(name, "--beep"))        options.mainboard.beepDuration = number;
+      else if (!strcmp(name, "--miss"))        options.mainboard.missedPresses = number;
+      else if (!strcmp(name, "--double"))      options.mainboard.doubleTriggers = number;
+      else if (!strcmp(name, "--noise"))       options.mainboard.bitErrors = number;
+      else if (!strcmp(name, "--min-success")) options.minSuccess = strtod(value, nullptr);
+      else if (!strcmp(name, "--capture"))     options.capture = value;
+      else if (!strcmp(name, "--expect"))      options.expect = value;
+      else if (!strcmp(name, "--frames"))      options.frames = number;
+      else return false;
+    }
+    return true;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (argc >= 2 && !strcmp(argv[1], "sim") && parseOptions(argc, argv, 2, options))
+  {
+    static Simulation simulation(options);
+    return simulation.run();
+  }
+  else if (argc >= 3 && !strcmp(argv[1], "replay") && parseOptions(argc, argv, 3, options))
+  {
+    options.input = argv[2];
+    static Replay replay(options);
+    return replay.run();
+  }
+  else if (argc >= 2 && !strcmp(argv[1], "bench"))
+  {
+    bool capture = argc >= 3 && strncmp(argv[2], "--", 2);
+    if (parseOptions(argc, argv, capture? 3 : 2, options) && options.frames)
+    {
+      options.input = capture? argv[2] : nullptr;
+      static Benchmark benchmark(options);
+      return benchmark.run();
+    }
+  }
+
+  usage();
+  return 2;
+}